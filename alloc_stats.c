@@ -0,0 +1,41 @@
+/*
+  DEIChain - Allocation Statistics Source Code
+  by
+    Samuel Riça (2023206471)
+    Diogo Santos (2023211097)
+
+  This file contains the allocation counters of DEIChain
+  (-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc). Allocations made
+  inside the C library (e.g. the temporary buffer of qsort()) never reach
+  the wrappers, so the checked loops must not call such functions.
+*/
+
+#include <stdlib.h>
+
+#include "alloc_stats.h"
+
+static _Thread_local unsigned long long allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+  allocations++;
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocations++;
+  return __real_realloc(ptr, size);
+}
+
+
+unsigned long long get_thread_allocations() {
+  return allocations;
+}
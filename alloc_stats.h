@@ -0,0 +1,20 @@
+/*
+  DEIChain - Allocation Statistics Header File
+  by
+    Samuel Riça (2023206471)
+    Diogo Santos (2023211097)
+*/
+
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+/*
+  Heap allocations made by the calling thread. The DEIChain objects are
+  linked with malloc, calloc and realloc wrapped (see the makefile), so only
+  the allocations of our own code are counted, not the ones made inside the
+  C library or libcrypto. Used to check that the miner and validator loops
+  do not allocate once running.
+*/
+unsigned long long get_thread_allocations();
+
+#endif
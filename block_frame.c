@@ -0,0 +1,197 @@
+/*
+  DEIChain - Block Frame Source Code
+  by
+    Samuel Riça (2023206471)
+    Diogo Santos (2023211097)
+
+  This file contains the framed wire format of the named pipe between the
+  miners and the validators (BLOCK_TRANSPORT=FIFO): batched vectored writes
+  on the miner side, multi-frame reads and resynchronization on the
+  validator side.
+*/
+
+#define _XOPEN_SOURCE 700  // IOV_MAX
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "block_frame.h"
+
+#define ALIGN(x, a) (((x) + (a) - 1) / (a) * (a))
+
+
+/*
+  FNV-1a hash of the payload
+*/
+static uint32_t frame_checksum(const void *data, size_t size) {
+  const unsigned char *bytes = data;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
+
+
+size_t get_frame_size(size_t payload_size) {
+  return ALIGN(sizeof(FrameHeader) + payload_size, 8);
+}
+
+
+void *frame_alloc(size_t payload_size, void **payload) {
+  size_t size = get_frame_size(payload_size);
+  char *frame = malloc(size);
+  memset(frame + size - 8, 0, 8);  // -> Padding
+  *payload = frame + sizeof(FrameHeader);
+  return frame;
+}
+
+
+void frame_seal(void *frame, size_t payload_size) {
+  FrameHeader *header = frame;
+  header->magic = FRAME_MAGIC;
+  header->version = FRAME_VERSION;
+  header->flags = 0;
+  header->length = payload_size;
+  header->checksum = frame_checksum((char*)frame + sizeof(FrameHeader), payload_size);
+}
+
+
+int frame_writev(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    ssize_t written = writev(fd, iov, count < IOV_MAX ? count : IOV_MAX);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+    // -- Skip what was written, a partially written frame is resumed where it stopped
+    while (written > 0) {
+      if ((size_t)written >= iov->iov_len) {
+        written -= iov->iov_len;
+        iov++;
+        count--;
+      }
+      else {
+        iov->iov_base = (char*)iov->iov_base + written;
+        iov->iov_len -= written;
+        written = 0;
+      }
+    }
+  }
+  return 1;
+}
+
+
+void frame_reader_init(FrameReader *reader, size_t payload_size) {
+  reader->payload_size = payload_size;
+  reader->capacity = get_frame_size(payload_size) * (FRAME_READ_BATCH + 1);
+  reader->buf = malloc(reader->capacity);
+  reader->start = 0;
+  reader->end = 0;
+}
+
+
+void frame_reader_free(FrameReader *reader) {
+  free(reader->buf);
+}
+
+
+/*
+  Auxiliary function to move the bytes not handed out yet to the start of
+  the buffer (keeps the frames 8-byte aligned)
+*/
+static void compact(FrameReader *reader) {
+  memmove(reader->buf, reader->buf + reader->start, reader->end - reader->start);
+  reader->end -= reader->start;
+  reader->start = 0;
+}
+
+
+/*
+  Auxiliary function to wait until the pipe has data (or was closed).
+  Returns 0 if STOP was set first.
+*/
+static int wait_readable(int fd, const volatile sig_atomic_t *stop) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (stop == NULL || !*stop) {
+    int ready = poll(&pfd, 1, stop == NULL ? -1 : FRAME_STOP_POLL_MS);
+    if (ready > 0)
+      return 1;
+    // -> Timeout or signal interruption: check STOP again
+  }
+  return 0;
+}
+
+
+int frame_reader_fill(FrameReader *reader, int fd, sem_t *mutex, const volatile sig_atomic_t *stop) {
+  compact(reader);
+  size_t frame_size = get_frame_size(reader->payload_size);
+  int total = 0;
+
+  while (total == 0) {
+    // -- Wait without the mutex, an idle reader never holds it
+    if (!wait_readable(fd, stop))
+      return FRAME_STOPPED;
+
+    while (sem_wait(mutex) == -1 && errno == EINTR);
+    while (1) {
+      ssize_t bytes = read(fd, reader->buf + reader->end, reader->capacity - reader->end);
+      if (bytes < 0 && errno == EINTR)
+        continue;
+      if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        if (total == 0)
+          break;  // -> Another reader drained the pipe first: wait again
+        struct pollfd pfd = {fd, POLLIN, 0};
+        poll(&pfd, 1, -1);  // -> The rest of the frame is being written
+        continue;
+      }
+      if (bytes <= 0) {
+        sem_post(mutex);
+        return total > 0 ? total : bytes;
+      }
+      reader->end += bytes;
+      total += bytes;
+      // -- Every frame has the same size: keep reading until the last one is complete
+      if ((reader->end - reader->start) % frame_size == 0)
+        break;
+    }
+    sem_post(mutex);
+  }
+  return total;
+}
+
+
+PipeMsg *frame_reader_next(FrameReader *reader, int *dropped) {
+  const uint32_t magic = FRAME_MAGIC;
+  while (reader->end - reader->start >= sizeof(FrameHeader)) {
+    FrameHeader *header = (FrameHeader*)(reader->buf + reader->start);
+    if (header->magic != FRAME_MAGIC || header->length != reader->payload_size) {
+      // -- Not the start of a frame: skip to the next FRAME_MAGIC
+      (*dropped)++;
+      size_t next = reader->start + 1;
+      while (next + sizeof(magic) <= reader->end && memcmp(reader->buf + next, &magic, sizeof(magic)) != 0)
+        next++;
+      if (next + sizeof(magic) > reader->end)
+        next = reader->end - sizeof(magic) + 1;  // -> The last bytes may start the next frame
+      reader->start = next;
+      compact(reader);
+      continue;
+    }
+
+    size_t frame_size = get_frame_size(header->length);
+    if (reader->end - reader->start < frame_size)
+      break;  // -> Incomplete, only after a resynchronization
+    char *payload = reader->buf + reader->start + sizeof(FrameHeader);
+    reader->start += frame_size;
+    if (header->version != FRAME_VERSION || header->checksum != frame_checksum(payload, header->length)) {
+      (*dropped)++;
+      continue;
+    }
+    return (PipeMsg*)payload;
+  }
+  return NULL;
+}
@@ -0,0 +1,89 @@
+/*
+  DEIChain - Block Frame Header File
+  by
+    Samuel Riça (2023206471)
+    Diogo Santos (2023211097)
+*/
+
+#ifndef BLOCK_FRAME_H
+#define BLOCK_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/uio.h>
+
+#include "structs.h"
+
+#define FRAME_MAGIC 0x42494544u   // "DEIB" in memory order
+#define FRAME_VERSION 1
+#define FRAME_READ_BATCH 8        // Max frames a validator drains per read()
+#define FRAME_STOP_POLL_MS 100    // Max time between two checks of a reader's stop flag
+#define FRAME_STOPPED -2          // frame_reader_fill() gave up because the stop flag was set
+
+/*
+  Header of a frame on the named pipe (BLOCK_TRANSPORT=FIFO). The payload
+  (a PipeMsg and its transactions) follows, padded to a multiple of 8 bytes
+  so the next frame stays aligned.
+*/
+typedef struct {
+  uint32_t magic;       // FRAME_MAGIC, marks the start of a frame
+  uint16_t version;     // FRAME_VERSION
+  uint16_t flags;       // Reserved (0)
+  uint32_t length;      // Payload bytes, without the padding
+  uint32_t checksum;    // FNV-1a of the payload
+} FrameHeader;
+
+/*
+  Validator side of the stream: frames are read in batches into `buf` and
+  handed out one at a time
+*/
+typedef struct {
+  char *buf;
+  size_t capacity;
+  size_t start;         // First byte not handed out yet
+  size_t end;           // End of the bytes read
+  size_t payload_size;  // Expected payload size, other frames are dropped
+} FrameReader;
+
+/*
+  Size of a whole frame (header, payload and padding)
+*/
+size_t get_frame_size(size_t payload_size);
+
+/*
+  Allocates a frame for a payload of the given size, returns it with the
+  payload at `*payload`. Call frame_seal() once the payload is written.
+*/
+void *frame_alloc(size_t payload_size, void **payload);
+void frame_seal(void *frame, size_t payload_size);
+
+/*
+  Writes every frame of `iov` with as few writev() calls as possible
+  (partial writes and signal interruptions are resumed). Returns 0 on error.
+*/
+int frame_writev(int fd, struct iovec *iov, int count);
+
+void frame_reader_init(FrameReader *reader, size_t payload_size);
+void frame_reader_free(FrameReader *reader);
+
+/*
+  Reads at least one complete frame, and as many more as are already in the
+  pipe (up to FRAME_READ_BATCH). `fd` must be non-blocking: readers wait
+  for data with poll() and only take `mutex` to drain it, holding it from
+  the first byte to the end of the last frame, so concurrent readers always
+  split the stream at frame boundaries. Returns the bytes read, 0 if the
+  pipe was closed, -1 on error or FRAME_STOPPED if `*stop` was set while
+  waiting (NULL waits forever).
+*/
+int frame_reader_fill(FrameReader *reader, int fd, sem_t *mutex, const volatile sig_atomic_t *stop);
+
+/*
+  Returns the payload of the next valid frame read, NULL if there is none
+  left. Damaged frames are skipped (the stream is resynchronized on the
+  next FRAME_MAGIC) and counted in `*dropped`.
+*/
+PipeMsg *frame_reader_next(FrameReader *reader, int *dropped);
+
+#endif
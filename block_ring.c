@@ -0,0 +1,109 @@
+/*
+  DEIChain - Block Ring Source Code
+  by
+    Samuel Riça (2023206471)
+    Diogo Santos (2023211097)
+
+  This file contains the shared memory block ring used by the miners to
+  hand mined blocks to the validators (BLOCK_TRANSPORT=RING).
+*/
+
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+#include "block_ring.h"
+
+#define ALIGN(x, a) (((x) + (a) - 1) / (a) * (a))
+#define SLOT_HEADER 64  // The sequence number has a cache line of its own
+
+
+static size_t get_block_slot_size(int tx_per_block) {
+  return ALIGN(SLOT_HEADER + sizeof(PipeMsg) + sizeof(Tx) * tx_per_block, 64);
+}
+
+static char *get_block_slot(BlockRing *ring, unsigned int pos) {
+  return (char*)ring + ALIGN(sizeof(BlockRing), 64) + (pos & ring->mask) * ring->slot_size;
+}
+
+static atomic_uint *get_slot_sequence(BlockRing *ring, unsigned int pos) {
+  return (atomic_uint*)get_block_slot(ring, pos);
+}
+
+/*
+  Auxiliary function to wait on a semaphore across signal interruptions (the
+  miner threads receive SIGUSR2). With a STOP flag, the wait is given up
+  (returns 0) once it is set, checked every BLOCK_RING_STOP_POLL_MS.
+*/
+static int wait_slots(sem_t *sem, const volatile sig_atomic_t *stop) {
+  if (stop == NULL) {
+    while (sem_wait(sem) == -1 && errno == EINTR);
+    return 1;
+  }
+  while (!*stop) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += BLOCK_RING_STOP_POLL_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    if (sem_timedwait(sem, &deadline) == 0)
+      return 1;
+    // -> Timeout or signal interruption: check STOP again
+  }
+  return 0;
+}
+
+/*
+  Auxiliary function to wait until a slot reaches the given sequence: a
+  slot can still be in use by the previous lap's (slower) miner or validator
+*/
+static void wait_sequence(BlockRing *ring, unsigned int pos, unsigned int sequence) {
+  while (atomic_load_explicit(get_slot_sequence(ring, pos), memory_order_acquire) != sequence)
+    sched_yield();
+}
+
+
+size_t get_block_ring_size(int num_slots, int tx_per_block) {
+  return ALIGN(sizeof(BlockRing), 64) + get_block_slot_size(tx_per_block) * num_slots;
+}
+
+
+void init_block_ring(BlockRing *ring, int num_slots, int tx_per_block) {
+  atomic_init(&ring->enqueue_pos, 0);
+  atomic_init(&ring->dequeue_pos, 0);
+  sem_init(&ring->free_slots, 1, num_slots);
+  sem_init(&ring->ready_slots, 1, 0);
+  ring->mask = num_slots - 1;
+  ring->slot_size = get_block_slot_size(tx_per_block);
+  for (int i = 0; i < num_slots; i++)
+    atomic_init(get_slot_sequence(ring, i), i);  // -> Slot i is free for the i-th claim
+}
+
+
+PipeMsg *block_ring_claim(BlockRing *ring, unsigned int *pos) {
+  wait_slots(&ring->free_slots, NULL);
+  *pos = atomic_fetch_add(&ring->enqueue_pos, 1);
+  wait_sequence(ring, *pos, *pos);
+  return (PipeMsg*)(get_block_slot(ring, *pos) + SLOT_HEADER);
+}
+
+
+void block_ring_publish(BlockRing *ring, unsigned int pos) {
+  atomic_store_explicit(get_slot_sequence(ring, pos), pos + 1, memory_order_release);
+  sem_post(&ring->ready_slots);
+}
+
+
+PipeMsg *block_ring_take(BlockRing *ring, unsigned int *pos, const volatile sig_atomic_t *stop) {
+  if (!wait_slots(&ring->ready_slots, stop))
+    return NULL;
+  *pos = atomic_fetch_add(&ring->dequeue_pos, 1);
+  wait_sequence(ring, *pos, *pos + 1);  // -> Published out of order: the miner may still be writing it
+  return (PipeMsg*)(get_block_slot(ring, *pos) + SLOT_HEADER);
+}
+
+
+void block_ring_release(BlockRing *ring, unsigned int pos) {
+  atomic_store_explicit(get_slot_sequence(ring, pos), pos + ring->mask + 1, memory_order_release);
+  sem_post(&ring->free_slots);
+}
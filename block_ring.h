@@ -0,0 +1,75 @@
+/*
+  DEIChain - Block Ring Header File
+  by
+    Samuel Riça (2023206471)
+    Diogo Santos (2023211097)
+*/
+
+#ifndef BLOCK_RING_H
+#define BLOCK_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <semaphore.h>
+#include <signal.h>
+
+#include "structs.h"
+
+#define BLOCK_RING_STOP_POLL_MS 100   // Max time between two checks of a validator's stop flag
+
+/*
+  How the miners hand mined blocks to the validators
+    TRANSPORT_RING -> shared memory block ring, blocks written and read in place
+    TRANSPORT_FIFO -> PipeMsg records on the named pipe (PIPE_NAME)
+*/
+typedef enum {
+  TRANSPORT_RING,
+  TRANSPORT_FIFO
+} BlockTransport;
+
+/*
+  Block ring: bounded MPMC queue of fixed-size block slots in shared memory.
+  Each slot holds a PipeMsg with room for tx_per_block transactions, which
+  the miner fills in place and the validator reads in place, so a block is
+  copied once (from the miner's buffer) and never goes through the kernel.
+  Slot positions are handed out with atomic counters and every slot has a
+  sequence number telling whether it is free, being written or published;
+  the two semaphores only make miners and validators sleep while the ring
+  is full or empty. The header is followed in memory by the slot array.
+*/
+typedef struct {
+  _Alignas(64) atomic_uint enqueue_pos;   // Next slot a miner claims
+  _Alignas(64) atomic_uint dequeue_pos;   // Next slot a validator takes
+  _Alignas(64) sem_t free_slots;          // Slots the miners can claim (process shared)
+  sem_t ready_slots;                      // Published blocks waiting for a validator (process shared)
+  unsigned int mask;                      // Number of slots - 1 (power of two)
+  size_t slot_size;                       // Bytes per slot (sequence line + PipeMsg + transactions)
+} BlockRing;
+
+/*
+  Computes the size of the block ring's shared memory
+*/
+size_t get_block_ring_size(int num_slots, int tx_per_block);
+
+/*
+  Initializes an empty ring (`num_slots` must be a power of two)
+*/
+void init_block_ring(BlockRing *ring, int num_slots, int tx_per_block);
+
+/*
+  Miner side: block_ring_claim() waits for a free slot and returns it to be
+  filled, block_ring_publish() hands it to the validators
+*/
+PipeMsg *block_ring_claim(BlockRing *ring, unsigned int *pos);
+void block_ring_publish(BlockRing *ring, unsigned int pos);
+
+/*
+  Validator side: block_ring_take() waits for a published block and returns
+  it, block_ring_release() gives the slot back once the block was validated.
+  Every slot taken must be released, a validator that stops (`*stop` set,
+  block_ring_take() returns NULL) releases its slots before exiting.
+*/
+PipeMsg *block_ring_take(BlockRing *ring, unsigned int *pos, const volatile sig_atomic_t *stop);
+void block_ring_release(BlockRing *ring, unsigned int pos);
+
+#endif
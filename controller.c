@@ -21,30 +21,38 @@
 #include <sys/wait.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include "utils.h"
 #include "structs.h"
 #include "miner.h"
 #include "statistics.h"
 #include "validator.h"
+#include "sha256.h"
+#include "tx_pool.h"
+#include "block_ring.h"
 
 // Semaphores and mutexes
 sem_t *log_mutex;         // Mutex to control writing to the log file
-sem_t *tx_pool_mutex;     // Mutex to control access to the Transactions Pool
 sem_t *tx_pool_full;      // Semaphore to control occupied slots in the Transactions Pool
 sem_t *tx_pool_empty;     // Semaphore to control available slots in the Transactions Pool
 sem_t *ledger_mutex;      // Mutex to control access to the Blockchain Ledger
-sem_t *pipe_mutex;        // Mutex to control access to the named pipe
+sem_t *pipe_mutex;        // Mutex to control writes to the named pipe
+sem_t *pipe_read_mutex;   // Mutex to keep the validators' reads on frame boundaries
 sem_t *hash_mutex;        // Mutex to control access to the hash of the last validated block
 sem_t *stats_done;        // Semaphore to block other processes while the statistics are being printed
 sem_t *check_occupancy;   // Semaphore to avoid busy waiting on the Validator Manager thread
+sem_t *tx_ring_doorbell;  // Semaphore to wake the ingestion thread when the ring was empty
 
 // Shared memory IDs
 int tx_pool_id;               // ID of the Transaction Pool's shared memory
 int blockchain_ledger_id;     // ID of the Blockchain Ledger's shared memory
+int block_ring_id = -1;       // ID of the block ring's shared memory
+TxPoolHeader *tx_pool_header; // Transactions Pool shared memory pointer (header with the free slots)
 TxPoolNode *tx_pool;          // Transactions Pool shared memory pointer (structs array)
 TxBlock *blockchain_ledger;   // Blockchain Ledger shared memory pointer (not mapped)
 TxBlock *blocks;              // Blockchain Ledger shared memory pointer (mapped)
+BlockRing *block_ring;        // Block ring shared memory pointer (BLOCK_TRANSPORT=RING)
 
 int msq_id;        // Message queue ID
 
@@ -59,8 +67,22 @@ int tx_pool_size;                 // Number of transaction slots in the Transact
 int tx_per_block;                 // Number of transactions per block
 int blockchain_blocks;            // Number of block slots in the Blockchain Ledger
 int stop_validator_manager;       // Flag to stop the validator manager
+int mining_mode;                  // One block per miner thread or cooperative mining
+int pow_workers;                  // Number of threads that mine each block in cooperative mode
+int speculative_mining;           // Mine the next block on top of the miner's own pending block
+int packing_max_age;              // Age from which a transaction is always packed into the next block
+int selection_policy;             // Order in which the miners select transactions from the pool
+int ingest_ring_size;             // Number of cells of the transaction ingestion ring
+int pool_shards;                  // Number of shards of the Transactions Pool
+int tx_lease_ms;                  // Time (ms) a miner holds the transactions of a block before the lease expires
+int block_transport;              // How mined blocks reach the validators (block ring or named pipe)
+int block_ring_slots;             // Number of block slots of the block ring
+int validator_threads;            // Number of PoW verification threads of each validator process
+int commit_batch;                 // Max blocks a validator commits together
+int commit_window_ms;             // Time (ms) a validator waits for more blocks to join a group
 FILE *log_file;                   // File pointer of the log file
 char *last_hash;                  // String containing the hash of the last block added to the ledger
+atomic_uint *tip_epoch;           // Chain tip epoch, incremented every time a block is added to the ledger
 
 void cleanup() {
   // Close the log file
@@ -68,13 +90,17 @@ void cleanup() {
 
   // Detaching and removing shared memory
   if (tx_pool_id >= 0) {
-    shmdt(tx_pool);
+    shmdt(tx_pool_header);
     shmctl(tx_pool_id, IPC_RMID, NULL);
   }
   if (blockchain_ledger_id >= 0) {
     shmdt(blockchain_ledger);
     shmctl(blockchain_ledger_id, IPC_RMID, NULL);
   }
+  if (block_ring_id >= 0) {
+    shmdt(block_ring);
+    shmctl(block_ring_id, IPC_RMID, NULL);
+  }
 
   // Removing the named pipe
   unlink(PIPE_NAME);
@@ -86,21 +112,23 @@ void cleanup() {
   sem_close(log_mutex);
   sem_close(tx_pool_empty);
   sem_close(tx_pool_full);
-  sem_close(tx_pool_mutex);
   sem_close(ledger_mutex);
   sem_close(pipe_mutex);
+  sem_close(pipe_read_mutex);
   sem_close(hash_mutex);
   sem_close(stats_done);
   sem_close(check_occupancy);
+  sem_close(tx_ring_doorbell);
   sem_unlink("LOG_MUTEX");
   sem_unlink("TX_POOL_EMPTY");
   sem_unlink("TX_POOL_FULL");
-  sem_unlink("TX_POOL_MUTEX");
   sem_unlink("LEDGER_MUTEX");
   sem_unlink("PIPE_MUTEX");
+  sem_unlink("PIPE_READ_MUTEX");
   sem_unlink("HASH_MUTEX");
   sem_unlink("STATS_DONE");
   sem_unlink("CHECK_OCCUPANCY");
+  sem_unlink("TX_RING_DOORBELL");
 }
 
 /*
@@ -156,33 +184,66 @@ void signals(int signum) {
   }
 }
 
+/*
+  Thread routine that moves the transactions published by the Transaction
+  Generators on the ingestion ring into the Transactions Pool. The ring is
+  drained in batches, so each shard lock is taken once per batch instead of
+  once per transaction and the generators never take them. A batch never
+  holds more transactions than the pool slots reserved for it.
+*/
+void* drain_ingestion_ring(void *args) {
+  log_message("[Controller] Ingestion thread launched successfully", 'r', DEBUG);
+  TxPoolHeader *tx_pool_header = (TxPoolHeader*)args;
+  TxRing *ring = get_tx_ring(tx_pool_header);
+  Tx batch[TX_RING_BATCH];
+  int reserved = 0;  // -> Pool slots already taken from TX_POOL_EMPTY and not yet filled
+
+  while (!stop_validator_manager) {
+    // -- Reserve the pool slots first (block for one, take any others that are free),
+    // -- so no transaction is ever taken off the ring without a slot to go to
+    if (reserved == 0) {
+      while (sem_wait(tx_pool_empty) == -1 && errno == EINTR);
+      reserved = 1;
+    }
+    while (reserved < TX_RING_BATCH && sem_trywait(tx_pool_empty) == 0)
+      reserved++;
+
+    int count = tx_ring_pop_batch(ring, batch, reserved);
+    if (count == 0) {
+      // -- Announce the wait before the last check, so no push is missed
+      atomic_store(&ring->consumer_waiting, 1);
+      atomic_thread_fence(memory_order_seq_cst);
+      if ((count = tx_ring_pop_batch(ring, batch, reserved)) == 0) {
+        sem_wait(tx_ring_doorbell);  // -> Keeps its reservation, only this thread fills the pool
+        continue;
+      }
+      atomic_store(&ring->consumer_waiting, 0);
+    }
+
+    reserved -= count;
+    tx_pool_insert_batch(tx_pool_header, tx_pool, batch, count);  // -> Never fails, the slots are reserved
+    for (int i = 0; i < count; i++)
+      sem_post(tx_pool_full);
+    sem_post(check_occupancy);  // -> Unblock the Validator Manager to check the pool's occupancy
+  }
+  pthread_exit(NULL);
+}
+
 /*
   Thread routine to manage the number of Validator threads
 */
 void* manage_validation(void *args) {
   log_message("[Controller] Validator Manager launched successfully", 'r', DEBUG);
-  TxPoolNode *tx_pool = (TxPoolNode*)args;
+  TxPoolHeader *tx_pool_header = (TxPoolHeader*)args;
   int size = tx_pool_size;
 
   // Flags
   int aux1 = 0, aux2 = 0;
 
-  // Calculate the occupancy of the transaction pool (TODO -> implement synchronization)
+  // Check the occupancy of the transaction pool (maintained counter, no pool lock needed)
   while (!stop_validator_manager) {
     sem_wait(check_occupancy); // -> Block until there is the need to check the pool's occupancy
-    sem_wait(tx_pool_mutex);
-    int occupated_blocks = 0;
-    for (int i = 0; i < size; i++) {
-      // -- Debug messages to check the status of the Transactions Pool
-      /*
-      if (tx_pool[i].empty == 0)
-        printf("[Validator] Block %2d status: %s\n", i, tx_pool[i].tx.id);
-      else
-        printf("[Validator] Block %2d status: EMPTY\n", i);
-      */
-      if (tx_pool[i].empty == 0)
-        occupated_blocks++;
-    }
+    int occupated_blocks = tx_pool_occupancy(tx_pool_header);
     
     // When enough transactions are available
     if (occupated_blocks >= tx_per_block) {
@@ -197,17 +258,22 @@ void* manage_validation(void *args) {
 
     int occupancy = (int)((float)occupated_blocks / size * 100);
     if (DEBUG)
-      printf("    [Controller] [Validator Manager] Current occupancy = %d%%\n", occupancy);
-    // If the pool occupancy falls below 40%, terminate any additional validators
+      printf("    [Controller] [Validator Manager] Current occupancy = %d%% (reward 1: %d | 2: %d | 3+: %d)\n", occupancy,
+             tx_pool_reward_count(tx_pool_header, 0), tx_pool_reward_count(tx_pool_header, 1),
+             tx_pool_reward_count(tx_pool_header, 2));
+    // If the pool occupancy falls below 40%, terminate any additional validators (SIGTERM:
+    // they validate the blocks they already read and give back their block ring slots first)
     if (occupancy < 40 && (aux1 == 1 || aux2 == 1)) {
       log_message("[Controller] [Validator Manager] Occupancy dropped below 40%. Terminating the additional Validator processes", 'r', DEBUG);
       if (aux1 == 1) {
-        kill(validator_pid[1], SIGKILL);
+        kill(validator_pid[1], SIGTERM);
+        waitpid(validator_pid[1], NULL, 0);
         aux1 = 0;
         validator_pid[1] = 0;
       }
       if (aux2 == 1) {
-        kill(validator_pid[2], SIGKILL);
+        kill(validator_pid[2], SIGTERM);
+        waitpid(validator_pid[2], NULL, 0);
         aux2 = 0;
         validator_pid[2] = 0;
       }
@@ -234,7 +300,6 @@ void* manage_validation(void *args) {
       if (validator_pid[2] < 0)
       log_message("[Controller] Error creating the 2nd auxiliary validator", 'w', 1);
     }
-    sem_post(tx_pool_mutex);
     sleep(2);
   }
   pthread_exit(NULL);
@@ -294,9 +359,98 @@ int main() {
   sprintf(msg, "[Controller] Loaded blockchain_blocks = %d", blockchain_blocks);
   log_message(msg, 'r', DEBUG);
 
+  // Optional settings
+  char option[20];
+  mining_mode = MINING_SOLO;
+  if (load_config_option("MINING_MODE", option, sizeof(option))) {
+    if (strcmp(option, "COOPERATIVE") == 0)
+      mining_mode = MINING_COOPERATIVE;
+    else if (strcmp(option, "SOLO") != 0)
+      log_message("[Controller] Invalid value for MINING_MODE, using SOLO", 'w', 1);
+  }
+  // -- Every miner thread has its own workers, by default the CPUs are split between them
+  pow_workers = load_config_int("POW_WORKERS", (int)sysconf(_SC_NPROCESSORS_ONLN) / num_miners);
+  if (pow_workers < 1)
+    pow_workers = 1;
+  if (mining_mode == MINING_COOPERATIVE)
+    sprintf(msg, "[Controller] Loaded mining_mode = COOPERATIVE (%d PoW workers)", pow_workers);
+  else
+    sprintf(msg, "[Controller] Loaded mining_mode = SOLO");
+  log_message(msg, 'r', DEBUG);
+  speculative_mining = load_config_int("SPECULATIVE_MINING", 0) != 0;
+  sprintf(msg, "[Controller] Loaded speculative_mining = %d", speculative_mining);
+  log_message(msg, 'r', DEBUG);
+  packing_max_age = load_config_int("PACKING_MAX_AGE", 50);
+  sprintf(msg, "[Controller] Loaded packing_max_age = %d", packing_max_age);
+  log_message(msg, 'r', DEBUG);
+  const char *policies[] = {"REWARD_PER_HASH", "HIGHEST_REWARD", "OLDEST", "CHEAPEST_POW"};
+  selection_policy = SELECT_REWARD_PER_HASH;
+  if (load_config_option("SELECTION_POLICY", option, sizeof(option))) {
+    int found = 0;
+    for (int i = 0; i < 4; i++)
+      if (strcmp(option, policies[i]) == 0) {
+        selection_policy = i;
+        found = 1;
+      }
+    if (!found)
+      log_message("[Controller] Invalid value for SELECTION_POLICY, using REWARD_PER_HASH", 'w', 1);
+  }
+  sprintf(msg, "[Controller] Loaded selection_policy = %s", policies[selection_policy]);
+  log_message(msg, 'r', DEBUG);
+  int ring_size = load_config_int("INGEST_RING_SIZE", 4096);
+  for (ingest_ring_size = 64; ingest_ring_size < ring_size; ingest_ring_size *= 2);  // -> Power of two
+  sprintf(msg, "[Controller] Loaded ingest_ring_size = %d", ingest_ring_size);
+  log_message(msg, 'r', DEBUG);
+  pool_shards = load_config_int("POOL_SHARDS", 8);
+  if (pool_shards < 1)
+    pool_shards = 1;
+  if (pool_shards > tx_pool_size)
+    pool_shards = tx_pool_size;
+  sprintf(msg, "[Controller] Loaded pool_shards = %d", pool_shards);
+  log_message(msg, 'r', DEBUG);
+  tx_lease_ms = load_config_int("TX_LEASE_MS", 30000);
+  if (tx_lease_ms < 1)
+    tx_lease_ms = 1;
+  sprintf(msg, "[Controller] Loaded tx_lease_ms = %d", tx_lease_ms);
+  log_message(msg, 'r', DEBUG);
+  block_transport = TRANSPORT_RING;
+  if (load_config_option("BLOCK_TRANSPORT", option, sizeof(option))) {
+    if (strcmp(option, "FIFO") == 0)
+      block_transport = TRANSPORT_FIFO;
+    else if (strcmp(option, "RING") != 0)
+      log_message("[Controller] Invalid value for BLOCK_TRANSPORT, using RING", 'w', 1);
+  }
+  int ring_slots = load_config_int("BLOCK_RING_SLOTS", 16);
+  for (block_ring_slots = 2; block_ring_slots < ring_slots; block_ring_slots *= 2);  // -> Power of two
+  if (block_transport == TRANSPORT_RING)
+    sprintf(msg, "[Controller] Loaded block_transport = RING (%d slots)", block_ring_slots);
+  else
+    sprintf(msg, "[Controller] Loaded block_transport = FIFO");
+  log_message(msg, 'r', DEBUG);
+  validator_threads = load_config_int("VALIDATOR_THREADS", 2);
+  if (validator_threads < 1)
+    validator_threads = 1;
+  sprintf(msg, "[Controller] Loaded validator_threads = %d", validator_threads);
+  log_message(msg, 'r', DEBUG);
+  commit_batch = load_config_int("COMMIT_BATCH", 8);
+  if (commit_batch < 1)
+    commit_batch = 1;
+  if (commit_batch > MAX_COMMIT_BATCH)
+    commit_batch = MAX_COMMIT_BATCH;
+  commit_window_ms = load_config_int("COMMIT_WINDOW_MS", 0);
+  if (commit_window_ms < 0)
+    commit_window_ms = 0;
+  sprintf(msg, "[Controller] Loaded commit_batch = %d (window %d ms)", commit_batch, commit_window_ms);
+  log_message(msg, 'r', DEBUG);
+
+  // Select the SHA-256 backend once, the forked processes inherit the choice
+  const Sha256Backend *sha256_backend = sha256_get_backend();
+  sprintf(msg, "[Controller] SHA-256 backend = %s (%d lanes)", sha256_backend->name, sha256_backend->lanes);
+  log_message(msg, 'r', DEBUG);
+
   // Shared memory
   // -- Create the Transaction Pool's shared memory
-  size_t size = sizeof(TxPoolNode) * tx_pool_size;
+  size_t size = get_tx_pool_size(tx_pool_size, ingest_ring_size, pool_shards);
   key_t tx_key = ftok("config.cfg", 'K');
   if ((tx_pool_id = shmget(tx_key, size, IPC_CREAT | 0766)) < 0) {
     log_message("[Controller] Error creating the Transaction Pool (Shared Memory)", 'w', 1);
@@ -306,7 +460,7 @@ int main() {
   log_message("[Controller] Transaction Pool created (shared memory)", 'r', DEBUG);
 
   // -- Attach the Transaction Pool to the shared memory
-  if ((tx_pool = (TxPoolNode*)shmat(tx_pool_id, NULL, 0)) < 0) {
+  if ((tx_pool_header = (TxPoolHeader*)shmat(tx_pool_id, NULL, 0)) == (void*)-1) {
 		log_message("[Controller] Error attaching the Transaction Pool (Shared Memory)", 'w', 1);
     cleanup();
 		exit(-1);
@@ -314,14 +468,12 @@ int main() {
   log_message("[Controller] Transaction Pool attached to shared memory", 'r', DEBUG);
 
   // -- Initialize the Transaction Pool elements
-  for (int i = 0; i < tx_pool_size; i++) {
-    tx_pool[i].empty = 1;
-    tx_pool[i].age = 0;
-  }
+  init_tx_pool(tx_pool_header, tx_pool_size, ingest_ring_size, pool_shards);
+  tx_pool = get_tx_pool_mapping(tx_pool_header);
   
 
   // -- Create the Blockchain Ledger
-  size = (sizeof(TxBlock) + sizeof(Tx) * tx_per_block) * blockchain_blocks + HASH_SIZE;
+  size = get_blockchain_size(blockchain_blocks, tx_per_block);
   if ((blockchain_ledger_id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0766)) < 0) {
     log_message("[Controller] Error creating the Blockchain Ledger", 'w', 1);
     cleanup();
@@ -338,7 +490,7 @@ int main() {
   log_message("[Controller] Blockchain Ledger attached to the shared memory", 'r', DEBUG);
 
   // -- Map the Blockchain Ledger elements in shared memory
-  get_blockchain_mapping(blockchain_ledger, blockchain_blocks, tx_per_block, &blocks, &last_hash);
+  get_blockchain_mapping(blockchain_ledger, blockchain_blocks, tx_per_block, &blocks, &last_hash, &tip_epoch);
 
   // -- Initialize the Ledger's blocks
   Timestamp t;
@@ -352,10 +504,26 @@ int main() {
     blocks[i].nonce = 0;
   }
   last_hash[0] = '\0';
+  atomic_init(tip_epoch, 0);
+
+  // -- Create the block ring (inherited by the Miner and Validator processes)
+  if (block_transport == TRANSPORT_RING) {
+    size = get_block_ring_size(block_ring_slots, tx_per_block);
+    if ((block_ring_id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0766)) < 0) {
+      log_message("[Controller] Error creating the block ring (Shared Memory)", 'w', 1);
+      cleanup();
+      exit(-1);
+    }
+    if ((block_ring = (BlockRing*)shmat(block_ring_id, NULL, 0)) == (void*)-1) {
+      log_message("[Controller] Error attaching the block ring (Shared Memory)", 'w', 1);
+      cleanup();
+      exit(-1);
+    }
+    init_block_ring(block_ring, block_ring_slots, tx_per_block);
+    log_message("[Controller] Block ring created (shared memory)", 'r', DEBUG);
+  }
 
   // Create semaphores and mutexes
-  sem_unlink("TX_POOL_MUTEX");
-  tx_pool_mutex = sem_open("TX_POOL_MUTEX", O_CREAT | O_EXCL, 0700, 1);
   sem_unlink("TX_POOL_FULL");
   tx_pool_full = sem_open("TX_POOL_FULL", O_CREAT | O_EXCL, 0700, 0);
   sem_unlink("TX_POOL_EMPTY");
@@ -364,12 +532,16 @@ int main() {
   ledger_mutex = sem_open("LEDGER_MUTEX", O_CREAT | O_EXCL, 0700, 1);
   sem_unlink("PIPE_MUTEX");
   pipe_mutex = sem_open("PIPE_MUTEX", O_CREAT | O_EXCL, 0700, 1);
+  sem_unlink("PIPE_READ_MUTEX");
+  pipe_read_mutex = sem_open("PIPE_READ_MUTEX", O_CREAT | O_EXCL, 0700, 1);
   sem_unlink("HASH_MUTEX");
   hash_mutex = sem_open("HASH_MUTEX", O_CREAT | O_EXCL, 0700, 1);
   sem_unlink("STATS_DONE");
   stats_done = sem_open("STATS_DONE", O_CREAT | O_EXCL, 0700, 0);
   sem_unlink("CHECK_OCCUPANCY");
   check_occupancy = sem_open("CHECK_OCCUPANCY", O_CREAT | O_EXCL, 0700, 0);
+  sem_unlink("TX_RING_DOORBELL");
+  tx_ring_doorbell = sem_open("TX_RING_DOORBELL", O_CREAT | O_EXCL, 0700, 0);
 
   // Create the message queue
   key_t msq_key = ftok("config.cfg", 'M');
@@ -380,7 +552,7 @@ int main() {
   }
 
   // Create the named pipe
-  if (mkfifo(PIPE_NAME, O_CREAT | O_EXCL | 0766) < 0) {
+  if (block_transport == TRANSPORT_FIFO && mkfifo(PIPE_NAME, O_CREAT | O_EXCL | 0766) < 0) {
     log_message("[Controller] Error creating the named pipe", 'w', 1);
     cleanup();
     exit(-1);
@@ -411,10 +583,16 @@ int main() {
   // ---- Launch the thread to manage the transaction pool occupancy
   pthread_t validator_manager_id;
   stop_validator_manager = 0;
-  if (pthread_create(&validator_manager_id, NULL, manage_validation, (void*)tx_pool) < 0) {
+  if (pthread_create(&validator_manager_id, NULL, manage_validation, (void*)tx_pool_header) < 0) {
     log_message("[Controller] Error launching the thread to manage validators", 'w', 1);
     exit(-1);
   }
+  // ---- Launch the thread that moves new transactions into the pool
+  pthread_t ingestion_id;
+  if (pthread_create(&ingestion_id, NULL, drain_ingestion_ring, (void*)tx_pool_header) < 0) {
+    log_message("[Controller] Error launching the transaction ingestion thread", 'w', 1);
+    exit(-1);
+  }
  
   // -- Statistics process
   if ((statistics_pid = fork()) == 0) {
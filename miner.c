@@ -15,10 +15,15 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <semaphore.h>
+#include <sys/msg.h>
 #include "utils.h"
 #include "miner.h"
 #include "structs.h"
 #include "pow.h"
+#include "tx_pool.h"
+#include "block_ring.h"
+#include "block_frame.h"
+#include "alloc_stats.h"
 
 #define BUF_SIZE 200
 
@@ -29,27 +34,334 @@ extern int num_miners;
 extern int tx_per_block;
 extern int tx_pool_size;
 extern int blockchain_blocks;
+extern int mining_mode;
+extern int pow_workers;
+extern int speculative_mining;
+extern int packing_max_age;
+extern int selection_policy;
+extern int tx_lease_ms;
+extern int block_transport;
+extern TxPoolHeader *tx_pool_header;
 extern TxPoolNode *tx_pool;
 extern TxBlock *blocks;
 extern TxBlock *blockchain_ledger;
+extern BlockRing *block_ring;
 
-extern sem_t *tx_pool_mutex;
 extern sem_t *pipe_mutex;
 extern sem_t *hash_mutex;
 extern sem_t *check_occupancy;
 
+extern int msq_id;
+
 extern char *last_hash;
+extern atomic_uint *tip_epoch;
+
+/*
+  Transactions signal flag of a miner thread, on its own cache line so the
+  threads polling their flags do not false share
+*/
+typedef struct {
+  _Alignas(64) int received;
+} MinerSignal;
+
+MinerSignal *signal_received;
+
+/*
+  Frames waiting to be written to the named pipe (one per miner thread at
+  most). The first waiting thread writes all of them with one writev().
+*/
+pthread_mutex_t outbox_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t outbox_written = PTHREAD_COND_INITIALIZER;
+struct iovec *outbox;       // Pending frames
+int **outbox_status;        // Status of each pending frame (0 while pending, 1 written, -1 failed)
+int outbox_count = 0;
+int outbox_writing = 0;     // Set while a thread writes a batch
+
+/*
+  Called by the PoW search when the chain tip moves: the work is still
+  valid if the new tip is the block's parent (speculative blocks)
+*/
+static int parent_became_tip(PoWAbort *abort) {
+  sem_wait(hash_mutex);
+  int is_parent = strcmp(last_hash, abort->previous_hash) == 0;
+  if (is_parent)
+    abort->expected = atomic_load(tip_epoch);
+  sem_post(hash_mutex);
+  return is_parent;
+}
+
+/*
+  Copy of a pool transaction gathered for the block assembly
+*/
+typedef struct {
+  Tx tx;
+  int age;
+  int taken;    // Already placed in the block being built
+} Candidate;
+
+/*
+  Candidates of every reward class, ordered from the oldest to the newest
+*/
+typedef struct {
+  Candidate *lists[NUM_REWARD_CLASSES];
+  int count[NUM_REWARD_CLASSES];
+  int *run_end[NUM_REWARD_CLASSES];     // End of every run of candidates already ordered by age
+  int num_runs[NUM_REWARD_CLASSES];
+  int *run_pos;                         // Merge cursor of every run
+  Candidate *merged;                    // Merge output, copied back to the list
+} CandidateSet;
+
+/*
+  Merges the runs of a reward class (one per shard and base class bucket,
+  each ordered by age) into a single list ordered by age. Works on the
+  buffers of the set, so it never allocates (qsort() may, inside libc).
+*/
+static void merge_runs(CandidateSet *set, int class) {
+  Candidate *list = set->lists[class];
+  int *run_end = set->run_end[class];
+  int runs = set->num_runs[class];
+  if (runs <= 1)
+    return;
+
+  for (int r = 0; r < runs; r++)
+    set->run_pos[r] = r == 0 ? 0 : run_end[r - 1];
+  for (int n = 0; n < set->count[class]; n++) {
+    int oldest = -1;
+    for (int r = 0; r < runs; r++)
+      if (set->run_pos[r] < run_end[r] &&
+          (oldest < 0 || list[set->run_pos[r]].age > list[set->run_pos[oldest]].age))
+        oldest = r;
+    set->merged[n] = list[set->run_pos[oldest]++];
+  }
+  memcpy(list, set->merged, set->count[class] * sizeof(Candidate));
+}
+
+/*
+  Copies the oldest tx_per_block transactions of every reward class of every
+  shard, locking one shard at a time (never the whole pool). Any block the
+  selection policies can build is made of these candidates. Leased
+  transactions (blocks being mined or validated) are skipped.
+
+  A reward class is made of a run of every base class bucket that is not
+  above it: from the cursor of the next class (or the head) to the cursor of
+  the class (or the tail).
+*/
+static void gather_candidates(CandidateSet *set) {
+  Tx *payloads = get_tx_pool_payloads(tx_pool_header);
+  long long now = tx_lease_clock();
+  for (int class = 0; class < NUM_REWARD_CLASSES; class++)
+    set->count[class] = set->num_runs[class] = 0;
+
+  for (int s = 0; s < tx_pool_header->num_shards; s++) {
+    TxPoolShard *shard = &tx_pool_header->shards[s];
+    sem_wait(&shard->mutex);
+    tx_shard_sync_age(shard, tx_pool_header, tx_pool);
+
+    for (int class = 0; class < NUM_REWARD_CLASSES; class++)
+      for (int base = 0; base <= class; base++) {
+        int first = class + 1 < NUM_REWARD_CLASSES ? shard->promote_cursor[base][class + 1] : shard->bucket_head[base];
+        int end = class > base ? shard->promote_cursor[base][class] : -1;
+        int copied = 0;
+        for (int cur = first; cur >= 0 && cur != end && copied < tx_per_block; cur = tx_pool[cur].next) {
+          if (tx_shard_leased(shard, tx_pool_header, cur, now))
+            continue;
+          Candidate *candidate = &set->lists[class][set->count[class]++];
+          candidate->tx = payloads[cur];
+          candidate->tx.reward = tx_shard_reward(shard, &tx_pool[cur]);
+          candidate->age = tx_shard_age(shard, &tx_pool[cur]);
+          candidate->taken = 0;
+          copied++;
+        }
+        if (copied > 0)
+          set->run_end[class][set->num_runs[class]++] = set->count[class];  // -> A bucket is ordered by age
+      }
+    sem_post(&shard->mutex);
+  }
+
+  // -- Merge the shards: each class is ordered by age again
+  for (int class = 0; class < NUM_REWARD_CLASSES; class++)
+    merge_runs(set, class);
+}
+
+/*
+  Takes up to `count` candidates from the reward classes `first` to `last`
+  (in that order, oldest first within each class)
+*/
+static int take_by_class(CandidateSet *set, int first, int last, Candidate **picked, int count) {
+  int num_taken = 0;
+  int step = first <= last ? 1 : -1;
+  for (int class = first; num_taken < count; class += step) {
+    for (int i = 0; i < set->count[class] && num_taken < count; i++)
+      if (!set->lists[class][i].taken) {
+        set->lists[class][i].taken = 1;
+        picked[num_taken++] = &set->lists[class][i];
+      }
+    if (class == last)
+      break;
+  }
+  return num_taken;
+}
+
+/*
+  Takes up to `count` candidates aged at least `min_age` from the reward
+  classes 0 to `last`, oldest first across the classes
+*/
+static int take_oldest(CandidateSet *set, int last, int min_age, Candidate **picked, int count) {
+  int cursor[NUM_REWARD_CLASSES] = {0};
+  int num_taken = 0;
+  while (num_taken < count) {
+    Candidate *best = NULL;
+    int best_class = -1;
+    for (int class = 0; class <= last; class++) {
+      while (cursor[class] < set->count[class] && set->lists[class][cursor[class]].taken)
+        cursor[class]++;
+      if (cursor[class] < set->count[class] &&
+          (best == NULL || set->lists[class][cursor[class]].age > best->age)) {
+        best = &set->lists[class][cursor[class]];
+        best_class = class;
+      }
+    }
+    if (best == NULL || best->age < min_age)
+      break;
+    best->taken = 1;
+    picked[num_taken++] = best;
+    cursor[best_class]++;
+  }
+  return num_taken;
+}
 
-int *signal_received;
+static void release_picked(Candidate **picked, int count) {
+  for (int i = 0; i < count; i++)
+    picked[i]->taken = 0;
+}
+
+/*
+  Fills a block that stays at the given difficulty level: the aged
+  transactions that fit first, then the highest reward classes
+*/
+static int fill_block(CandidateSet *set, int level, Candidate **picked) {
+  int count = take_oldest(set, level - 1, packing_max_age, picked, tx_per_block);
+  return count + take_by_class(set, level - 1, 0, picked + count, tx_per_block - count);
+}
+
+/*
+  Difficulty-aware packing (SELECTION_POLICY=REWARD_PER_HASH). A block is as
+  hard as its highest reward, so one reward 3 transaction makes a block of
+  reward 1 transactions HARD. For every difficulty level the best block that
+  stays at that level is built, and the one with the most credits per
+  expected hash wins. Transactions aged PACKING_MAX_AGE or more are packed
+  first and set the minimum level, so high rewards are not starved.
+*/
+static int pack_by_reward_per_hash(CandidateSet *set, Candidate **picked) {
+  // -- The highest class with an aged transaction sets the minimum level
+  int min_level = EASY;
+  for (int class = 0; class < NUM_REWARD_CLASSES; class++)
+    if (set->count[class] > 0 && set->lists[class][0].age >= packing_max_age)
+      min_level = class + 1;
+
+  int best_level = 0;
+  double best_score = 0;
+  for (int level = min_level; level <= HARD; level++) {
+    int count = fill_block(set, level, picked);
+    int credits = 0, block_level = EASY;
+    for (int i = 0; i < count; i++) {
+      int reward = picked[i]->tx.reward;
+      credits += reward;
+      if (getDifficultFromReward(reward) > block_level)
+        block_level = getDifficultFromReward(reward);
+    }
+    release_picked(picked, count);
+    if (count < tx_per_block)
+      continue;
+
+    double score = credits / get_expected_hashes(block_level);
+    if (best_level == 0 || score > best_score) {
+      best_level = level;
+      best_score = score;
+    }
+  }
+  return best_level == 0 ? 0 : fill_block(set, best_level, picked);
+}
+
+/*
+  Selects the block's transactions from the gathered candidates according
+  to the selection policy. `picked` is scratch space for tx_per_block
+  pointers. Returns the number of transactions written to `transactions`.
+*/
+static int pack_block(CandidateSet *set, Tx *transactions, Candidate **picked) {
+  int count;
+  switch (selection_policy) {
+    case SELECT_HIGHEST_REWARD:
+      count = take_by_class(set, NUM_REWARD_CLASSES - 1, 0, picked, tx_per_block);
+      break;
+    case SELECT_OLDEST:
+      count = take_oldest(set, NUM_REWARD_CLASSES - 1, 0, picked, tx_per_block);
+      break;
+    case SELECT_CHEAPEST_POW:
+      count = take_by_class(set, 0, NUM_REWARD_CLASSES - 1, picked, tx_per_block);
+      break;
+    default:
+      count = pack_by_reward_per_hash(set, picked);
+  }
+
+  for (int i = 0; i < count; i++)
+    transactions[i] = picked[i]->tx;
+  return count;
+}
 
 void min_tx_handler(int signum) {
   pthread_mutex_lock(&min_tx_mutex);
   for (int i = 0; i < num_miners; i++)
-    signal_received[i] = 1;
+    signal_received[i].received = 1;
   pthread_cond_broadcast(&min_tx);
   pthread_mutex_unlock(&min_tx_mutex);
 }
 
+/*
+  Sends a sealed frame on the named pipe. Frames of threads
+  that finish at the same time are written together: the thread that finds
+  no batch in progress writes every pending frame (under pipe_mutex), the
+  others wait for it, so the frame can be reused once this returns. Returns
+  0 if the write of its batch failed.
+*/
+static int send_frame(int fd, void *frame, size_t size) {
+  int status = 0;
+  pthread_mutex_lock(&outbox_mutex);
+  outbox[outbox_count].iov_base = frame;
+  outbox[outbox_count].iov_len = size;
+  outbox_status[outbox_count++] = &status;
+  while (status == 0) {
+    if (outbox_writing) {
+      pthread_cond_wait(&outbox_written, &outbox_mutex);
+      continue;
+    }
+
+    // -- Take the whole batch and write it
+    int count = outbox_count;
+    struct iovec iov[count];
+    int *statuses[count];
+    for (int i = 0; i < count; i++) {
+      iov[i] = outbox[i];  // -> frame_writev() moves iov_base
+      statuses[i] = outbox_status[i];
+    }
+    outbox_count = 0;
+    outbox_writing = 1;
+    pthread_mutex_unlock(&outbox_mutex);
+
+    sem_wait(pipe_mutex);
+    int ok = frame_writev(fd, iov, count);
+    sem_post(pipe_mutex);
+
+    pthread_mutex_lock(&outbox_mutex);
+    for (int i = 0; i < count; i++)
+      *statuses[i] = ok ? 1 : -1;
+    outbox_writing = 0;
+    pthread_cond_broadcast(&outbox_written);
+  }
+  pthread_mutex_unlock(&outbox_mutex);
+  return status == 1;
+}
+
 void* miner_routine(void* miner_id) {
   // Thread initialization
   int id = *(int*)miner_id;
@@ -57,155 +369,228 @@ void* miner_routine(void* miner_id) {
   sprintf(msg, "[Miner] Thread %d initialized", id);
   log_message(msg, 'r', 1);
 
-  int fd = open(PIPE_NAME, O_WRONLY);
+  int fd = block_transport == TRANSPORT_FIFO ? open(PIPE_NAME, O_WRONLY) : -1;
 
   // Miner thread routine
   int block_count = 0;
+  int reassemble = 0;  // -> Set after dropping stale work, the next block is assembled right away
+
+  // Speculation state: the last block sent for validation, while it is still pending
+  int speculate = 0;
+  char parent_hash[HASH_SIZE];            // -> Hash of the pending block
+  char parent_previous_hash[HASH_SIZE];   // -> Tip the pending block was mined on
+  // Block packing scratch space
+  CandidateSet candidates;
+  int max_runs = NUM_REWARD_CLASSES * tx_pool_header->num_shards;
+  for (int i = 0; i < NUM_REWARD_CLASSES; i++) {
+    candidates.lists[i] = (Candidate*)malloc(sizeof(Candidate) * max_runs * tx_per_block);
+    candidates.run_end[i] = (int*)malloc(sizeof(int) * max_runs);
+  }
+  candidates.run_pos = (int*)malloc(sizeof(int) * max_runs);
+  candidates.merged = (Candidate*)malloc(sizeof(Candidate) * max_runs * tx_per_block);
+  Candidate **picked = (Candidate**)malloc(sizeof(Candidate*) * tx_per_block);
+  // Per-block buffers, reused by every block so the loop does not allocate
+  Tx *block_txs = (Tx*)malloc(sizeof(Tx) * tx_per_block);
+  size_t payload_size = sizeof(PipeMsg) + tx_per_block * sizeof(Tx);
+  PipeMsg *frame_data = NULL;
+  void *frame = block_transport == TRANSPORT_FIFO ? frame_alloc(payload_size, (void**)&frame_data) : NULL;
+  pow_thread_init();
+  PoWGroup pow_group;  // -> Cooperative mode: threads that mine every block of this miner with it
+  if (mining_mode == MINING_COOPERATIVE)
+    pow_group_init(&pow_group, pow_workers);
   while (1) {
     // -- Check the available transactions
-    if (DEBUG)
-      printf("    [Miner Thread %d] *** Miner %d waiting for the transactions signal\n", id, id);
-    sem_post(check_occupancy);  // -> Unblock the Validator Manager to check the pool's occupancy
-    pthread_mutex_lock(&min_tx_mutex);
-    while (!signal_received[id-1]) {
-      pthread_cond_wait(&min_tx, &min_tx_mutex);
+    if (!reassemble) {
+      if (DEBUG)
+        printf("    [Miner Thread %d] *** Miner %d waiting for the transactions signal\n", id, id);
+      sem_post(check_occupancy);  // -> Unblock the Validator Manager to check the pool's occupancy
+      pthread_mutex_lock(&min_tx_mutex);
+      while (!signal_received[id-1].received) {
+        pthread_cond_wait(&min_tx, &min_tx_mutex);
+      }
+      signal_received[id-1].received = 0;
+      pthread_mutex_unlock(&min_tx_mutex);
+      if (DEBUG)
+        printf("    [Miner Thread %d] *** Miner %d received transactions signal\n", id, id);
     }
-    signal_received[id-1] = 0;
-    pthread_mutex_unlock(&min_tx_mutex);
-    if (DEBUG)
-      printf("    [Miner Thread %d] *** Miner %d received transactions signal\n", id, id);
+    reassemble = 0;
 
     // -- Ensure that there are enough transactions in the pool before assembling the block
-    sem_wait(tx_pool_mutex);
-    int available_tx = 0;
-    for (int i = 0; i < tx_pool_size; i++)
-      if (tx_pool[i].empty == 0) available_tx++;
-    sem_post(tx_pool_mutex);
+    int available_tx = tx_pool_occupancy(tx_pool_header);  // -> No need for the shard locks
+
+    // -- Speculative blocks cannot reuse the pending block's transactions
+    if (speculate && available_tx < 2 * tx_per_block) {
+      speculate = 0;
+      reassemble = 1;  // -> Retry as a regular block
+      continue;
+    }
 
     // -- Not enough transactions => go back to waiting
     if (available_tx < tx_per_block)
       continue;
 
     // -- Assemble a new block
+    unsigned long long allocations = get_thread_allocations();
     TxBlock block;
     char buf[64];
     sprintf(buf, "BLOCK-%lu-%d", pthread_self(), block_count);
     strcpy(block.id, buf);
+    PoWAbort stale_check;  // -> The block becomes stale once the chain tip moves
+    stale_check.epoch = tip_epoch;
+    stale_check.tip_changed = parent_became_tip;
+    stale_check.previous_hash = block.previous_block_hash;
     sem_wait(hash_mutex);
     if (last_hash[0] == '\0')
       strcpy(block.previous_block_hash, INITIAL_HASH);
     else
       strcpy(block.previous_block_hash, last_hash);
+    // -- The pending block is still on top of the tip => build on it
+    if (speculate && strcmp(block.previous_block_hash, parent_previous_hash) == 0)
+      strcpy(block.previous_block_hash, parent_hash);
+    else
+      speculate = 0;  // -> Already added to the ledger or lost to another block
+    stale_check.expected = atomic_load(tip_epoch);
     sem_post(hash_mutex);
 
     // -- Fill the block with transactions
-    block.transactions = (Tx*)malloc(sizeof(Tx)*tx_per_block);
-    sem_wait(tx_pool_mutex);
+    block.transactions = block_txs;
 
     // -- Select transactions from the Transactions Pool
     if (DEBUG)
       printf("[Miner Thread %d] Assembling block\n", id);
-    int num_selected = 0;
-    for (int i = 0; i < tx_per_block; i++) {
-      for (int j = 0; j < tx_pool_size; j++) {
-        TxPoolNode *cur = &tx_pool[j];
-        if (cur->empty == 1) // -> Skip empty slots
-          continue;
-
-        // -- Miners with even thread ID => prioritize easier transactions
-        if (id % 2 == 0) {
-          if (cur->selected == 0 && (cur->tx.reward) == EASY) {
-            strcpy(block.transactions[i].id, cur->tx.id);
-            block.transactions[i].reward = cur->tx.reward;
-            block.transactions[i].timestamp = cur->tx.timestamp;
-            block.transactions[i].value = cur->tx.value;
-            cur->selected = 1;
-            num_selected++;
-            break;
-          }
-        }
-        // -- Miners with odd thread ID => prioritize selecting sequential transactions
-        else {
+    gather_candidates(&candidates);
+    int num_selected = pack_block(&candidates, block.transactions, picked);
 
-        }
-      }
-    }
-    // -- Select remaining transactions if there are empty slots in the block
+    // -- Not enough unleased transactions => go back to waiting
     if (num_selected < tx_per_block) {
-      for (int i = num_selected; i < tx_per_block; i++) {
-        for (int j = 0; j < tx_pool_size; j++) {
-          TxPoolNode *cur = &tx_pool[j];
-          if (cur->empty == 1) // -> Skip empty slots
-            continue;
-          if (cur->selected == 0) {
-            strcpy(block.transactions[i].id, cur->tx.id);
-            block.transactions[i].reward = cur->tx.reward;
-            block.transactions[i].timestamp = cur->tx.timestamp;
-            block.transactions[i].value = cur->tx.value;
-            cur->selected = 1;
-            num_selected++;
-            break;
-          }
-        }
-      }
+      speculate = 0;
+      continue;
+    }
+
+    // -- Reserve the transactions, another miner may have leased some of them since they were copied
+    if (!tx_pool_lease(tx_pool_header, tx_pool, block.transactions, tx_per_block, id, tx_lease_ms)) {
+      reassemble = 1;
+      continue;
     }
-    // -- Reset the selected flag in all nodes of the transaction pool
-    for (int i = 0; i < tx_pool_size; i++)
-      tx_pool[i].selected = 0;
-    sem_post(tx_pool_mutex);
 
     block.timestamp = get_timestamp();  // -> Assign the timestamp of the instant the block's assembly is completed
 
     // Get the miner to perform the PoW step
-    sprintf(msg, "[Miner Thread %d] Started mining block %s", id, block.id);
+    if (speculate)
+      sprintf(msg, "[Miner Thread %d] Started mining block %s on top of pending block", id, block.id);
+    else
+      sprintf(msg, "[Miner Thread %d] Started mining block %s", id, block.id);
     log_message(msg, 'r', 1);
+    int speculative = speculate;  // -> Tells the validators to wait for the pending block
+    speculate = 0;
 
+    // The 64-bit nonce space is never exhausted, so a single search is enough
     PoWResult result;
-    do {
-      block.timestamp = get_timestamp();
-      result = proof_of_work(&block); // -> Find a valid nonce
-    } while (result.error == 1);
+    if (mining_mode == MINING_COOPERATIVE)
+      result = proof_of_work_parallel(&block, &pow_group, &stale_check); // -> Find a valid nonce with several threads
+    else
+      result = proof_of_work(&block, &stale_check); // -> Find a valid nonce
 
-    // If the number of operations reaches the limit
-    /*
+    // If the block could not be prepared for hashing
     if (result.error) {
-      sprintf(msg, "[Miner Thread %d] Failed to mine block %s: max operations reached", id, block.id);
-      log_message(msg, 'w', DEBUG);
-      free(block.transactions); // -> Free allocated memory
+      sprintf(msg, "[Miner Thread %d] Failed to mine block %s", id, block.id);
+      log_message(msg, 'w', 1);
+      tx_pool_release(tx_pool_header, tx_pool, block.transactions, tx_per_block, id);
       continue;                 // -> Assemble a new block and try again
     }
-    */
+
+    // If another block was added to the ledger in the meantime, drop the stale work
+    if (result.aborted) {
+      sprintf(msg, "[Miner Thread %d] Dropped block %s: the chain tip changed while mining", id, block.id);
+      log_message(msg, 'w', 1);
+
+      Message to_send;
+      memset(&to_send, 0, sizeof(Message));
+      to_send.msgtype = MSG_STALE_WORK;
+      to_send.num_results = 1;
+      to_send.results[0].miner_id = id;
+      to_send.results[0].mining_cpu_time = result.cpu_time;
+      to_send.results[0].mining_hashes = result.operations;
+      msgsnd(msq_id, &to_send, MESSAGE_SIZE(1), 0);
+
+      tx_pool_release(tx_pool_header, tx_pool, block.transactions, tx_per_block, id);
+      reassemble = 1;           // -> Assemble a new block on top of the new tip
+      continue;
+    }
+
+    sprintf(msg, "[Miner Thread %d] Block %s mined in %.3f s (%llu hashes)", id, block.id,
+            result.elapsed_time, (unsigned long long)result.operations);
+    log_message(msg, 'r', DEBUG);
 
     // -- If the mining process succeeds
     sprintf(msg, "[Miner Thread %d] Successfully mined block %s", id, block.id);
     log_message(msg, 'r', 1);
 
-    // Send the block to the validators via Named Pipe
-    PipeMsg *block_data = malloc(sizeof(PipeMsg) + tx_per_block * sizeof(Tx));
+    // Send the block to the validators: written in place in a block ring slot, or framed via Named Pipe
+    unsigned int slot_pos = 0;
+    PipeMsg *block_data;
+    if (block_transport == TRANSPORT_RING)
+      block_data = block_ring_claim(block_ring, &slot_pos);
+    else
+      block_data = frame_data;  // -> Free again, send_frame() waits for the previous write
     block_data->miner_id = id;
+    block_data->mining_cpu_time = result.cpu_time;
+    block_data->mining_hashes = result.operations;
+    block_data->speculative = speculative;
     block_data->block = block;
     //block_data->block.transactions = NULL;
     strcpy(block_data->result_hash, result.hash);
     memcpy(block_data->transactions, block.transactions, tx_per_block * sizeof(Tx));
 
-    sem_wait(pipe_mutex);
-    if (fd < 0) {
-      sprintf(msg, "[Miner Thread %d] Error opening the named pipe", id);
-      log_message(msg, 'w', 1);
+    if (block_transport == TRANSPORT_RING)
+      block_ring_publish(block_ring, slot_pos);
+    else {
+      frame_seal(frame, payload_size);
+      if (fd < 0 || !send_frame(fd, frame, get_frame_size(payload_size))) {
+        sprintf(msg, "[Miner Thread %d] Error writing to the named pipe", id);
+        log_message(msg, 'w', 1);
+        tx_pool_release(tx_pool_header, tx_pool, block.transactions, tx_per_block, id);  // -> The block never reaches a validator
+        continue;
+      }
     }
 
-    write(fd, block_data, sizeof(PipeMsg) + tx_per_block * sizeof(Tx)); // -> Send the block data
-    sem_post(pipe_mutex);
-
     sprintf(msg, "[Miner Thread %d] Sent block %s for validation", id, block.id);
     log_message(msg, 'r', 1);
 
+    // -- Start the next block right away on top of this one while it is validated
+    if (speculative_mining) {
+      sem_wait(hash_mutex);
+      speculate = strcmp(last_hash[0] == '\0' ? INITIAL_HASH : last_hash, block.previous_block_hash) == 0;
+      sem_post(hash_mutex);
+      if (speculate) {
+        strcpy(parent_hash, result.hash);
+        strcpy(parent_previous_hash, block.previous_block_hash);
+        reassemble = 1;
+      }
+    }
+
+    // -- Debug check: mining and sending a block must not touch the heap
+    if (DEBUG && get_thread_allocations() != allocations) {
+      sprintf(msg, "[Miner Thread %d] %llu heap allocations while handling block %s", id,
+              get_thread_allocations() - allocations, block.id);
+      log_message(msg, 'w', 1);
+    }
+
     // Prepare the assembly of the next block
     block_count++;
-    free(block_data);
-    free(block.transactions);
   } // -> while (1)
-  
+  if (mining_mode == MINING_COOPERATIVE)
+    pow_group_free(&pow_group);
+  for (int i = 0; i < NUM_REWARD_CLASSES; i++) {
+    free(candidates.lists[i]);
+    free(candidates.run_end[i]);
+  }
+  free(candidates.run_pos);
+  free(candidates.merged);
+  free(picked);
+  free(block_txs);
+  free(frame);
+
   // Thread termination
   sprintf(msg, "[Miner] Thread %d terminated", id);
   log_message(msg, 'r', 1);
@@ -225,24 +610,22 @@ void miner() {
   sprintf(msg, "[Miner] Process initialized (PID -> %d | parent PID -> %d)", getpid(), getppid());
   log_message(msg, 'r', DEBUG);
 
-  signal_received = calloc(num_miners, sizeof(int));  // -> Flag array to check if the signal was already captured by the current thread
+  // -- Flag array to check if the signal was already captured by the current thread
+  signal_received = aligned_alloc(64, sizeof(MinerSignal) * num_miners);
+  memset(signal_received, 0, sizeof(MinerSignal) * num_miners);
+  outbox = malloc(sizeof(struct iovec) * num_miners);
+  outbox_status = malloc(sizeof(int*) * num_miners);
 
   // Set up the signal handler
   struct sigaction act;
   act.sa_handler = min_tx_handler;
   sigaction(SIGUSR2, &act, NULL);
 
-  // Open the named semaphore
-  tx_pool_mutex = sem_open("TX_POOL_MUTEX", 0);
-  if (tx_pool_mutex == SEM_FAILED) {
-    printf("\x1b[31m[!]\x1b[0m tx_pool_mutex not initialized yet. Closing.\n");
-    exit(-1);
-  }
-
   // Re-map shared memory to get consistent pointers
   TxBlock *blocks;
   char *last_hash;
-  get_blockchain_mapping(blockchain_ledger, blockchain_blocks, tx_per_block, &blocks, &last_hash);
+  atomic_uint *tip_epoch;
+  get_blockchain_mapping(blockchain_ledger, blockchain_blocks, tx_per_block, &blocks, &last_hash, &tip_epoch);
   
   // Create the miner threads
   int miner_id[num_miners];
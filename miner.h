@@ -10,6 +10,35 @@
 
 #include "structs.h"
 
+/*
+  Mining modes (MINING_MODE setting):
+    SOLO        -> each miner thread mines its own block (throughput)
+    COOPERATIVE -> each block is mined by POW_WORKERS threads that split the
+                   nonce space (latency), started once per miner thread
+                   (default: the online CPUs split between the miners)
+*/
+typedef enum { MINING_SOLO = 0, MINING_COOPERATIVE = 1 } MiningMode;
+
+/*
+  Transaction selection policies (SELECTION_POLICY setting):
+    REWARD_PER_HASH -> most credits per expected hash, aged transactions first
+    HIGHEST_REWARD  -> highest reward class first, oldest first within a class
+    OLDEST          -> oldest transactions first
+    CHEAPEST_POW    -> lowest reward class (easiest PoW) first
+*/
+typedef enum {
+  SELECT_REWARD_PER_HASH = 0,
+  SELECT_HIGHEST_REWARD = 1,
+  SELECT_OLDEST = 2,
+  SELECT_CHEAPEST_POW = 3
+} SelectionPolicy;
+
+/*
+  Speculative mining (SPECULATIVE_MINING=1): once a block is sent for
+  validation, its miner starts the next block on top of it instead of
+  waiting for the validator. Only one pending parent is allowed per miner.
+*/
+
 void* miner_routine(void*);
 void miner();
 
@@ -3,6 +3,8 @@
 #include "pow.h"
 
 #include <openssl/sha.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,13 +26,39 @@ int get_max_transaction_reward(const TxBlock *block,
   return max_reward;
 }
 
-unsigned char *serialize_block(const TxBlock *block, size_t *sz_buf) {
+/* Offset of the nonce inside the serialized block */
+static inline size_t get_nonce_offset() {
+  return TXB_ID_LEN + HASH_SIZE + sizeof(Timestamp) + tx_per_block * sizeof(Tx);
+}
+
+/*
+  Serialization buffer of the calling thread: its size only depends on
+  tx_per_block, so it is allocated once and reused for every block (it only
+  grows again if tx_per_block does, e.g. between PoWBench runs)
+*/
+static _Thread_local unsigned char *serialize_buffer = NULL;
+static _Thread_local size_t serialize_capacity = 0;
+
+void pow_thread_init() {
+  size_t size = get_transaction_block_size() - sizeof(Tx *);
+  if (size > serialize_capacity) {
+    unsigned char *buffer = realloc(serialize_buffer, size);
+    if (buffer == NULL)
+      return;  // -> serialize_block() reports the error
+    serialize_buffer = buffer;
+    serialize_capacity = size;
+  }
+}
+
+/* Serializes the block into the thread's buffer (valid until the next call) */
+static unsigned char *serialize_block(const TxBlock *block, size_t *sz_buf) {
   // We must subtract the size of the pointer, the static block does not have
   // the pointer
   *sz_buf = get_transaction_block_size() - sizeof(Tx *);
 
-  unsigned char *buffer = malloc(*sz_buf);
-  if (!buffer) return NULL;
+  pow_thread_init();
+  if (serialize_capacity < *sz_buf) return NULL;
+  unsigned char *buffer = serialize_buffer;
 
   unsigned char *p = buffer;
 
@@ -48,8 +76,12 @@ unsigned char *serialize_block(const TxBlock *block, size_t *sz_buf) {
     p += sizeof(Tx);
   }
 
-  memcpy(p, &block->nonce, sizeof(int));
-  p += sizeof(int);
+  memcpy(p, &block->nonce, sizeof(uint64_t));
+  p += sizeof(uint64_t);
+
+  // The trailing bytes after the nonce are zeroed so they are always the
+  // same, otherwise the miner and the validator could hash different garbage
+  memset(p, 0, buffer + *sz_buf - p);
 
   return buffer;
 }
@@ -57,18 +89,74 @@ unsigned char *serialize_block(const TxBlock *block, size_t *sz_buf) {
 /* Function to compute SHA-256 hash */
 void compute_sha256(const TxBlock *block, char *output) {
   unsigned char hash[SHA256_DIGEST_LENGTH];
-  // create a static buffer to copy data
   size_t buffer_sz;
 
   // since the Block has a pointer we must serialize the block to a buffer
   unsigned char *buffer = serialize_block(block, &buffer_sz);
 
   SHA256(buffer, buffer_sz, hash);
+  digest_to_hex(hash, output);
+}
+
+/* Function to convert a raw digest to its hex string */
+void digest_to_hex(const unsigned char *digest, char *output) {
   for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-    sprintf(output + (i * 2), "%02x", hash[i]);
+    sprintf(output + (i * 2), "%02x", digest[i]);
   }
   output[SHA256_DIGEST_LENGTH * 2] = '\0';
-  free(buffer);
+}
+
+/*
+  Function to prepare the mining engine of a block: hashes every full 64-byte
+  block that precedes the nonce and keeps the remaining bytes, already padded,
+  in the engine's tail. Returns 0 if the block could not be serialized.
+*/
+int pow_engine_init(PoWEngine *engine, const TxBlock *block) {
+  size_t buffer_sz;
+  unsigned char *buffer = serialize_block(block, &buffer_sz);
+  if (!buffer) return 0;
+
+  size_t nonce_offset = get_nonce_offset();
+  size_t prefix_sz = nonce_offset - nonce_offset % SHA256_BLOCK_SIZE;
+
+  sha256_init_state(engine->midstate);
+  for (size_t i = 0; i < prefix_sz; i += SHA256_BLOCK_SIZE)
+    sha256_compress(engine->midstate, buffer + i);
+
+  size_t tail_len = buffer_sz - prefix_sz;
+  memcpy(engine->tails[0], buffer + prefix_sz, tail_len);
+  engine->tail_size = sha256_pad_tail(engine->tails[0], tail_len, buffer_sz);
+  engine->nonce_offset = nonce_offset - prefix_sz;
+
+  engine->backend = sha256_get_backend();
+  for (int l = 1; l < engine->backend->lanes; l++)
+    memcpy(engine->tails[l], engine->tails[0], engine->tail_size);
+
+  return 1;
+}
+
+/* Function to hash the engine's block with the given nonce */
+void pow_engine_hash(PoWEngine *engine, uint64_t nonce, unsigned char *digest) {
+  uint32_t state[8];
+
+  memcpy(engine->tails[0] + engine->nonce_offset, &nonce, sizeof(uint64_t));
+  memcpy(state, engine->midstate, sizeof(state));
+  for (size_t i = 0; i < engine->tail_size; i += SHA256_BLOCK_SIZE)
+    sha256_compress(state, engine->tails[0] + i);
+  sha256_state_to_digest(state, digest);
+}
+
+/*
+  Function to hash one nonce per backend lane, starting at `first_nonce`.
+  The final state of lane `l` is written to `states + l * 8`.
+*/
+void pow_engine_hash_lanes(PoWEngine *engine, uint64_t first_nonce, uint32_t *states) {
+  for (int l = 0; l < engine->backend->lanes; l++) {
+    uint64_t nonce = first_nonce + l;
+    memcpy(engine->tails[l] + engine->nonce_offset, &nonce, sizeof(uint64_t));
+  }
+  engine->backend->compress_lanes(engine->midstate, &engine->tails[0][0], sizeof(engine->tails[0]),
+                                  engine->tail_size / SHA256_BLOCK_SIZE, states);
 }
 
 /* Function to check difficulty using fractional levels */
@@ -105,11 +193,14 @@ int check_difficulty(const char *hash, const int reward) {
   return 0;
 }
 
-/* Function to verify a nonce */
-int verify_nonce(const TxBlock *block) {
-  char hash[SHA256_DIGEST_LENGTH * 2 + 1];
-  if (DEBUG)
-    printf("[DEBUG] *** verify_nonce using tx_per_block=%d\n", tx_per_block);
+/*
+  Function to verify a nonce: the block is hashed once with its current nonce.
+  If HASH is not NULL, the computed hash is copied to it
+*/
+int verify_nonce(const TxBlock *block, char *hash) {
+  char computed[SHA256_DIGEST_LENGTH * 2 + 1];
+  if (hash == NULL)
+    hash = computed;
 
   if (block->transactions == NULL) {
     printf("[DEBUG] *** Block has NULL transactions pointer\n");
@@ -117,47 +208,276 @@ int verify_nonce(const TxBlock *block) {
   }
   int reward = get_max_transaction_reward(block, tx_per_block);
   compute_sha256(block, hash);
-  if (DEBUG)
-    printf("[DEBUG] *** Hash: %-30s\n", hash);
   return check_difficulty(hash, reward);
 }
 
-/* Proof-of-Work function */
-PoWResult proof_of_work(TxBlock *block) {
+/* Function to read the CPU time consumed by the calling thread */
+static double thread_cpu_time() {
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/*
+  Proof-of-Work function. If ABORT is not NULL, the search stops as soon as
+  the chain tip moves and the result is flagged as aborted
+*/
+PoWResult proof_of_work(TxBlock *block, PoWAbort *abort) {
   PoWResult result;
 
   result.elapsed_time = 0.0;
+  result.cpu_time = 0.0;
   result.operations = 0;
   result.error = 0;
+  result.aborted = 0;
 
   block->nonce = 0;
 
   int reward = get_max_transaction_reward(block, tx_per_block);
+  PoWTarget target = get_difficulty_target(reward);
+
+  PoWEngine engine;
+  if (!pow_engine_init(&engine, block)) {
+    result.error = 1;
+    return result;
+  }
 
-  char hash[SHA256_DIGEST_LENGTH * 2 + 1];
+  int lanes = engine.backend->lanes;
+  uint32_t states[SHA256_MAX_LANES * 8];
+  unsigned char digest[SHA256_DIGEST_LENGTH];
   clock_t start = clock();
+  double cpu_start = thread_cpu_time();
+  uint64_t next_poll = POW_POLL_INTERVAL;
 
+  // The 64-bit nonce space cannot be exhausted, the search only ends with a
+  // valid hash or when the work becomes stale
   while (1) {
-    compute_sha256(block, hash);
-
-    if (check_difficulty(hash, reward)) {
-      result.elapsed_time = (double)(clock() - start) / CLOCKS_PER_SEC;
-      strcpy(result.hash, hash);
-      return result;
+    pow_engine_hash_lanes(&engine, block->nonce, states);
+    result.operations += lanes;
+
+    // Lanes are checked in nonce order, so the first valid nonce is kept
+    for (int l = 0; l < lanes; l++) {
+      if (meets_target(states + l * 8, &target)) {
+        block->nonce += l;
+        result.elapsed_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        result.cpu_time = thread_cpu_time() - cpu_start;
+        sha256_state_to_digest(states + l * 8, digest);
+        digest_to_hex(digest, result.hash);  // -> Only the winning hash is hex encoded
+        return result;
+      }
     }
-    block->nonce++;
-    if (block->nonce > POW_MAX_OPS) {
-      fprintf(stderr, "Giving up\n");
-      result.elapsed_time = (double)(clock() - start) / CLOCKS_PER_SEC;
-      result.error = 1;
-      return result;
+    block->nonce += lanes;
+
+    if (result.operations >= next_poll) {
+      next_poll += POW_POLL_INTERVAL;
+      if (pow_is_stale(abort)) {
+        result.elapsed_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+        result.cpu_time = thread_cpu_time() - cpu_start;
+        result.aborted = 1;
+        return result;
+      }
     }
-    //if (DEBUG && block->nonce % 100000 == 0)
-     // printf("Nounce %d\n", block->nonce);
-    result.operations++;
   }
 }
 
+/*
+  Shared state of a cooperative PoW search: the workers claim disjoint chunks
+  of POW_CHUNK_SIZE nonces and publish the lowest valid nonce they find
+*/
+typedef struct {
+  PoWEngine engine;       // Prepared once, copied by every worker
+  PoWTarget target;
+  PoWAbort *abort;        // Chain tip check (NULL if the search cannot become stale)
+  pthread_mutex_t mutex;  // Protects the fields below
+  uint64_t next_chunk;    // Next chunk to be claimed
+  uint64_t best_nonce;    // Lowest valid nonce found (UINT64_MAX while none)
+  uint64_t operations;    // Hashes computed by all workers
+  double cpu_time;        // CPU time of all workers
+  int aborted;            // Set when the work became stale
+} CoopSearch;
+
+static void *pow_worker(void *arg) {
+  CoopSearch *search = (CoopSearch *)arg;
+  PoWEngine engine = search->engine;
+  int lanes = engine.backend->lanes;
+  uint32_t states[SHA256_MAX_LANES * 8];
+  double cpu_start = thread_cpu_time();
+
+  while (1) {
+    // -- Claim the next chunk, unless a lower nonce was already found or the work is stale
+    pthread_mutex_lock(&search->mutex);
+    if (pow_is_stale(search->abort))
+      search->aborted = 1;
+    uint64_t start = search->next_chunk++ * POW_CHUNK_SIZE;
+    int stop = start > search->best_nonce || search->aborted;
+    pthread_mutex_unlock(&search->mutex);
+    if (stop)
+      break;
+
+    // -- Search the chunk in nonce order
+    uint64_t found = UINT64_MAX, ops = 0;
+    for (uint64_t nonce = start; nonce < start + POW_CHUNK_SIZE && found == UINT64_MAX; nonce += lanes) {
+      pow_engine_hash_lanes(&engine, nonce, states);
+      ops += lanes;
+      for (int l = 0; l < lanes; l++) {
+        if (meets_target(states + l * 8, &search->target)) {
+          found = nonce + l;
+          break;
+        }
+      }
+    }
+
+    pthread_mutex_lock(&search->mutex);
+    search->operations += ops;
+    if (found < search->best_nonce)
+      search->best_nonce = found;
+    pthread_mutex_unlock(&search->mutex);
+  }
+
+  pthread_mutex_lock(&search->mutex);
+  search->cpu_time += thread_cpu_time() - cpu_start;
+  pthread_mutex_unlock(&search->mutex);
+  return NULL;
+}
+
+/* Routine of a helper thread: runs every search handed out to its group */
+static void *pow_group_helper(void *arg) {
+  PoWGroup *group = (PoWGroup *)arg;
+  unsigned int last_search = 0;
+
+  pthread_mutex_lock(&group->mutex);
+  while (1) {
+    while (group->search_id == last_search && !group->shutdown)
+      pthread_cond_wait(&group->start, &group->mutex);
+    if (group->shutdown)
+      break;
+    last_search = group->search_id;
+    CoopSearch *search = (CoopSearch *)group->search;
+    pthread_mutex_unlock(&group->mutex);
+
+    pow_worker(search);
+
+    pthread_mutex_lock(&group->mutex);
+    if (--group->running == 0)
+      pthread_cond_signal(&group->done);
+  }
+  pthread_mutex_unlock(&group->mutex);
+  return NULL;
+}
+
+/*
+  Starts the NUM_WORKERS - 1 helper threads of a cooperative PoW group (the
+  helpers block every signal, those are handled by the calling process'
+  own threads). Returns the number of workers available, the caller
+  included (1 if no helper could be started).
+*/
+int pow_group_init(PoWGroup *group, int num_workers) {
+  group->num_helpers = 0;
+  group->search_id = 0;
+  group->running = 0;
+  group->shutdown = 0;
+  group->search = NULL;
+  pthread_mutex_init(&group->mutex, NULL);
+  pthread_cond_init(&group->start, NULL);
+  pthread_cond_init(&group->done, NULL);
+  group->helpers = num_workers > 1 ? malloc(sizeof(pthread_t) * (num_workers - 1)) : NULL;
+  if (group->helpers == NULL)
+    return 1;
+
+  sigset_t all, previous;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &previous);
+  for (int i = 0; i < num_workers - 1; i++)
+    if (pthread_create(&group->helpers[group->num_helpers], NULL, pow_group_helper, group) == 0)
+      group->num_helpers++;
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+  return group->num_helpers + 1;
+}
+
+/* Stops and joins the helper threads of a cooperative PoW group */
+void pow_group_free(PoWGroup *group) {
+  pthread_mutex_lock(&group->mutex);
+  group->shutdown = 1;
+  pthread_cond_broadcast(&group->start);
+  pthread_mutex_unlock(&group->mutex);
+  for (int i = 0; i < group->num_helpers; i++)
+    pthread_join(group->helpers[i], NULL);
+  free(group->helpers);
+  pthread_cond_destroy(&group->start);
+  pthread_cond_destroy(&group->done);
+  pthread_mutex_destroy(&group->mutex);
+}
+
+/*
+  Cooperative Proof-of-Work: the workers of GROUP (the caller included)
+  split the nonce space of the same block and stop as soon as no unsearched
+  chunk can hold a lower valid nonce. The result is the lowest valid nonce,
+  the same one proof_of_work() would find.
+*/
+PoWResult proof_of_work_parallel(TxBlock *block, PoWGroup *group, PoWAbort *abort) {
+  PoWResult result;
+
+  result.elapsed_time = 0.0;
+  result.cpu_time = 0.0;
+  result.operations = 0;
+  result.error = 0;
+  result.aborted = 0;
+
+  block->nonce = 0;
+
+  CoopSearch search;
+  if (!pow_engine_init(&search.engine, block)) {
+    result.error = 1;
+    return result;
+  }
+  search.target = get_difficulty_target(get_max_transaction_reward(block, tx_per_block));
+  pthread_mutex_init(&search.mutex, NULL);
+  search.next_chunk = 0;
+  search.best_nonce = UINT64_MAX;
+  search.operations = 0;
+  search.cpu_time = 0.0;
+  search.aborted = 0;
+  search.abort = abort;
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);  // -> Wall time, clock() adds up the CPU time of all workers
+
+  // -- Hand the search to the helpers, the calling thread is the last worker
+  pthread_mutex_lock(&group->mutex);
+  group->search = &search;
+  group->running = group->num_helpers;
+  group->search_id++;
+  pthread_cond_broadcast(&group->start);
+  pthread_mutex_unlock(&group->mutex);
+
+  pow_worker(&search);
+
+  // -- The search lives on this stack, wait for every helper to leave it
+  pthread_mutex_lock(&group->mutex);
+  while (group->running > 0)
+    pthread_cond_wait(&group->done, &group->mutex);
+  group->search = NULL;
+  pthread_mutex_unlock(&group->mutex);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  result.elapsed_time = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  result.operations = search.operations;
+  result.cpu_time = search.cpu_time;
+  pthread_mutex_destroy(&search.mutex);
+
+  // A valid nonce found before the tip moved is still reported as stale work
+  if (search.aborted) {
+    result.aborted = 1;
+    return result;
+  }
+
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  block->nonce = search.best_nonce;
+  pow_engine_hash(&search.engine, block->nonce, digest);
+  digest_to_hex(digest, result.hash);
+  return result;
+}
+
 DifficultyLevel getDifficultFromReward(const int reward) {
   if (reward <= 1)
     // 0000
@@ -171,3 +491,36 @@ DifficultyLevel getDifficultFromReward(const int reward) {
   // 00000[0-b]
   return HARD;
 }
+
+double get_expected_hashes(const int reward) {
+  // -- Only the first word of the target is non-zero
+  return 4294967296.0 / get_difficulty_target(reward).words[0];
+}
+
+/*
+  Function to convert a difficulty level to its binary target. The hex rules
+  of check_difficulty() only constrain the first 6 nibbles of the hash:
+    EASY   0000[0-b] -> hash < 0x0000c000 00..00
+    NORMAL 00000     -> hash < 0x00001000 00..00
+    HARD   00000[0-b]-> hash < 0x00000c00 00..00
+*/
+PoWTarget get_difficulty_target(const int reward) {
+  PoWTarget target;
+  memset(&target, 0, sizeof(target));
+
+  switch (getDifficultFromReward(reward)) {
+    case EASY:
+      target.words[0] = 0x0000c000;
+      break;
+    case NORMAL:
+      target.words[0] = 0x00001000;
+      break;
+    case HARD:
+      target.words[0] = 0x00000c00;
+      break;
+    default:
+      fprintf(stderr, "Invalid Difficult\n");
+      exit(2);
+  }
+  return target;
+}
@@ -2,12 +2,16 @@
 #ifndef POW_H
 #define POW_H
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "structs.h"
+#include "sha256.h"
 
-#define POW_MAX_OPS 10000000
+#define POW_CHUNK_SIZE 4096   // Nonces claimed at a time by a cooperative PoW worker
+#define POW_POLL_INTERVAL 1024  // Hashes between two checks of the chain tip epoch
 
 #define INITIAL_HASH \
   "00006a8e76f31ba74e21a092cca1015a418c9d5f4375e7a4fec676e1d2ec1436"
@@ -20,17 +24,106 @@ typedef enum { EASY = 1, NORMAL = 2, HARD = 3 } DifficultyLevel;
 typedef struct {
   char hash[HASH_SIZE];
   double elapsed_time;
-  int operations;
-  int error;
+  double cpu_time;       // CPU time of the thread(s) that performed the search
+  uint64_t operations;   // Hashes computed during the search
+  int error;             // Set when the block could not be prepared for hashing
+  int aborted;           // Set when the search was dropped because the chain tip changed
 } PoWResult;
 
+/*
+  Stale-work check: the search is aborted as soon as the chain tip epoch
+  differs from `expected` (polled every POW_POLL_INTERVAL hashes). If set,
+  `tip_changed` is called first and may keep the work alive by returning 1
+  and updating `expected` (e.g. when the new tip is the block's parent).
+*/
+typedef struct PoWAbort {
+  const atomic_uint *epoch;
+  unsigned int expected;
+  int (*tip_changed)(struct PoWAbort *abort);
+  const char *previous_hash;   // Hash the block builds on
+} PoWAbort;
+
+/*
+  Persistent group of cooperative PoW workers: NUM_WORKERS - 1 helper
+  threads are started once by pow_group_init() and sleep until
+  proof_of_work_parallel() hands them a search (the caller is the last
+  worker), so no thread is created per block.
+*/
+typedef struct {
+  pthread_t *helpers;
+  int num_helpers;        // Helper threads started
+  pthread_mutex_t mutex;  // Protects the fields below
+  pthread_cond_t start;   // Signaled when a new search is handed out
+  pthread_cond_t done;    // Signaled when the last helper finishes the search
+  unsigned int search_id; // Incremented for every search handed out
+  int running;            // Helpers still working on the current search
+  int shutdown;           // Set by pow_group_free()
+  void *search;           // Current search
+} PoWGroup;
+
+/*
+  Mining engine: the block is serialized once and the SHA-256 state of the
+  constant prefix (every 64-byte block before the nonce) is saved, so each
+  nonce attempt only compresses the padded tail (one or two blocks). The tail
+  is replicated once per lane of the hashing backend, so consecutive nonces
+  are hashed in parallel.
+*/
+typedef struct {
+  uint32_t midstate[8];                                         // SHA-256 state after the prefix
+  unsigned char tails[SHA256_MAX_LANES][2 * SHA256_BLOCK_SIZE]; // Padded tail of each lane
+  size_t tail_size;                                             // 64 or 128 bytes
+  size_t nonce_offset;                                          // Offset of the nonce in a tail
+  const Sha256Backend *backend;                                 // Backend chosen at startup
+} PoWEngine;
+
+/*
+  Difficulty target as a 256-bit big-endian number (8 words, most significant
+  first): a hash is valid when it is strictly below the target.
+*/
+typedef struct {
+  uint32_t words[8];
+} PoWTarget;
+
 int get_max_transaction_reward(const TxBlock *block, const int txs_per_block);
+
+/*
+  Allocates the calling thread's block serialization buffer (sized from
+  tx_per_block), which compute_sha256() and pow_engine_init() reuse for
+  every block. Done on the first use if not called at startup, and grown
+  again if tx_per_block increases.
+*/
+void pow_thread_init();
 void compute_sha256(const TxBlock *input, char *output);
-PoWResult proof_of_work(TxBlock *block);
-int verify_nonce(const TxBlock *block);
+int pow_engine_init(PoWEngine *engine, const TxBlock *block);
+void pow_engine_hash(PoWEngine *engine, uint64_t nonce, unsigned char *digest);
+void pow_engine_hash_lanes(PoWEngine *engine, uint64_t first_nonce, uint32_t *states);
+void digest_to_hex(const unsigned char *digest, char *output);
+PoWResult proof_of_work(TxBlock *block, PoWAbort *abort);
+int pow_group_init(PoWGroup *group, int num_workers);
+void pow_group_free(PoWGroup *group);
+PoWResult proof_of_work_parallel(TxBlock *block, PoWGroup *group, PoWAbort *abort);
+int verify_nonce(const TxBlock *block, char *hash);
 int check_difficulty(const char *hash, const int reward);
 DifficultyLevel getDifficultFromReward(const int reward);
 
+/* Average number of hashes needed to mine a block with the given reward */
+double get_expected_hashes(const int reward);
+PoWTarget get_difficulty_target(const int reward);
+
+// Inline function to check if the work of a PoW search became stale
+static inline int pow_is_stale(PoWAbort *abort) {
+  if (abort == NULL || atomic_load_explicit(abort->epoch, memory_order_relaxed) == abort->expected)
+    return 0;
+  return abort->tip_changed == NULL || !abort->tip_changed(abort);
+}
+
+// Inline function to check a raw SHA-256 state (digest words) against a target
+static inline int meets_target(const uint32_t *state, const PoWTarget *target) {
+  for (int i = 0; i < 8; i++)
+    if (state[i] != target->words[i]) return state[i] < target->words[i];
+  return 0;
+}
+
 // Inline function to compute the size of a TransactionBlock
 static inline size_t get_transaction_block_size() {
   if (tx_per_block == 0) {
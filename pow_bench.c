@@ -0,0 +1,275 @@
+/* pow_bench.c - Proof-of-Work microbenchmark
+
+  Drives compute_sha256(), proof_of_work() and verify_nonce() directly on
+  synthetic blocks, for several transactions-per-block values and every
+  difficulty level, and reports the results as a table and as JSON.
+
+  Usage: PoWBench [-t 1,10,50] [-b blocks] [-n hashes] [-B backend] [-j file]
+    -t  comma separated list of transactions per block (default 1,10,50,100)
+    -b  blocks mined per configuration for the time-to-solution stats (default 20)
+    -n  iterations of the compute_sha256()/verify_nonce() loops (default 100000)
+    -B  SHA-256 backend (generic, sse4, avx2, avx512, shani), default is auto
+    -j  write the JSON report to this file ("-" for stdout)
+
+  Heap allocations are counted by wrapping malloc/calloc/realloc at link time
+  (see the makefile), so only the allocations made by the PoW code are
+  counted (not the ones made inside the C library or libcrypto).
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pow.h"
+#include "sha256.h"
+
+#define MAX_TX_SIZES 16
+
+int tx_per_block;
+
+// Allocation counters (-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc)
+static unsigned long long allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+  allocations++;
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocations++;
+  return __real_realloc(ptr, size);
+}
+
+/* Results of one (transactions per block, difficulty) configuration */
+typedef struct {
+  int tx_per_block;
+  DifficultyLevel difficulty;
+  double sha256_hps;          // compute_sha256() hashes per second
+  double sha256_ns;           // compute_sha256() ns per hash
+  double sha256_allocs;       // Allocations per compute_sha256() call
+  double pow_hps;             // proof_of_work() hashes per second
+  double pow_ns;              // proof_of_work() ns per hash
+  double pow_allocs;          // Allocations per hash inside proof_of_work()
+  double tts_min, tts_median, tts_p90, tts_max, tts_mean;  // Time to solution (s)
+  double verify_per_sec;      // verify_nonce() calls per second
+  double verify_allocs;       // Allocations per verify_nonce() call
+} BenchResult;
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Builds a synthetic block whose transactions all have the given reward */
+static void make_block(TxBlock *block, Tx *transactions, int reward, int seq) {
+  memset(block, 0, sizeof(TxBlock));
+  snprintf(block->id, TXB_ID_LEN, "BENCH-%d-%d", reward, seq);
+  strcpy(block->previous_block_hash, INITIAL_HASH);
+  block->timestamp.hour = 12;
+  block->timestamp.min = seq / 60 % 60;
+  block->timestamp.sec = seq % 60;
+  block->transactions = transactions;
+
+  memset(transactions, 0, sizeof(Tx) * tx_per_block);
+  for (int i = 0; i < tx_per_block; i++) {
+    snprintf(transactions[i].id, sizeof(transactions[i].id), "TX-BENCH-%d-%d", seq, i);
+    transactions[i].reward = reward;
+    transactions[i].value = (i * 37) % 100 + 1;
+    transactions[i].timestamp = block->timestamp;
+  }
+}
+
+static void run_config(BenchResult *res, int num_blocks, int iterations) {
+  Tx *transactions = malloc(sizeof(Tx) * tx_per_block);
+  TxBlock block;
+  char hash[HASH_SIZE];
+  int reward = res->difficulty;
+
+  // -- compute_sha256(): full serialization + one-shot hash per call
+  make_block(&block, transactions, reward, 0);
+  unsigned long long allocs = allocations;
+  double start = now();
+  for (int i = 0; i < iterations; i++) {
+    block.nonce = i;
+    compute_sha256(&block, hash);
+  }
+  double elapsed = now() - start;
+  res->sha256_hps = iterations / elapsed;
+  res->sha256_ns = elapsed * 1e9 / iterations;
+  res->sha256_allocs = (double)(allocations - allocs) / iterations;
+
+  // -- proof_of_work(): time to solution of NUM_BLOCKS different blocks
+  double *tts = malloc(sizeof(double) * num_blocks);
+  unsigned long long hashes = 0;
+  double total = 0;
+  allocs = allocations;
+  for (int b = 0; b < num_blocks; b++) {
+    make_block(&block, transactions, reward, b + 1);
+    start = now();
+    PoWResult result = proof_of_work(&block, NULL);
+    tts[b] = now() - start;
+    total += tts[b];
+    hashes += result.operations;
+  }
+  res->pow_hps = hashes / total;
+  res->pow_ns = total * 1e9 / hashes;
+  res->pow_allocs = (double)(allocations - allocs) / hashes;
+
+  qsort(tts, num_blocks, sizeof(double), compare_doubles);
+  res->tts_min = tts[0];
+  res->tts_median = tts[num_blocks / 2];
+  res->tts_p90 = tts[(int)(num_blocks * 0.9) < num_blocks ? (int)(num_blocks * 0.9) : num_blocks - 1];
+  res->tts_max = tts[num_blocks - 1];
+  res->tts_mean = total / num_blocks;
+  free(tts);
+
+  // -- verify_nonce(): the last mined block is verified over and over
+  allocs = allocations;
+  start = now();
+  for (int i = 0; i < iterations; i++)
+    if (!verify_nonce(&block, hash)) {
+      fprintf(stderr, "verify_nonce() rejected a mined block\n");
+      exit(1);
+    }
+  elapsed = now() - start;
+  res->verify_per_sec = iterations / elapsed;
+  res->verify_allocs = (double)(allocations - allocs) / iterations;
+
+  free(transactions);
+}
+
+static const char *difficulty_name(DifficultyLevel difficulty) {
+  switch (difficulty) {
+    case EASY: return "EASY";
+    case NORMAL: return "NORMAL";
+    default: return "HARD";
+  }
+}
+
+static void print_table(BenchResult *results, int count, const Sha256Backend *backend) {
+  printf("\nSHA-256 backend: %s (%d lanes)\n\n", backend->name, backend->lanes);
+  printf("%-5s %-7s | %-26s | %-26s | %-37s | %-17s\n", "", "",
+         "compute_sha256()", "proof_of_work()", "time to solution (ms)", "verify_nonce()");
+  printf("%-5s %-7s | %10s %7s %7s | %10s %7s %7s | %8s %8s %8s %9s | %9s %7s\n", "tx", "level",
+         "H/s", "ns/H", "alloc/H", "H/s", "ns/H", "alloc/H", "min", "median", "p90", "max", "calls/s",
+         "alloc");
+  for (int i = 0; i < count; i++) {
+    BenchResult *r = &results[i];
+    printf("%-5d %-7s | %10.0f %7.1f %7.3f | %10.0f %7.1f %7.5f | %8.2f %8.2f %8.2f %9.2f | %9.0f %7.3f\n",
+           r->tx_per_block, difficulty_name(r->difficulty), r->sha256_hps, r->sha256_ns,
+           r->sha256_allocs, r->pow_hps, r->pow_ns, r->pow_allocs, r->tts_min * 1e3,
+           r->tts_median * 1e3, r->tts_p90 * 1e3, r->tts_max * 1e3, r->verify_per_sec,
+           r->verify_allocs);
+  }
+}
+
+static void write_json(FILE *out, BenchResult *results, int count, const Sha256Backend *backend,
+                       int num_blocks, int iterations) {
+  fprintf(out, "{\n  \"backend\": \"%s\",\n  \"lanes\": %d,\n", backend->name, backend->lanes);
+  fprintf(out, "  \"blocks_per_config\": %d,\n  \"iterations\": %d,\n  \"results\": [\n", num_blocks,
+          iterations);
+  for (int i = 0; i < count; i++) {
+    BenchResult *r = &results[i];
+    fprintf(out,
+            "    {\"tx_per_block\": %d, \"difficulty\": \"%s\",\n"
+            "     \"compute_sha256\": {\"hashes_per_sec\": %.1f, \"ns_per_hash\": %.2f, \"allocs_per_hash\": %.4f},\n"
+            "     \"proof_of_work\": {\"hashes_per_sec\": %.1f, \"ns_per_hash\": %.2f, \"allocs_per_hash\": %.6f,\n"
+            "       \"time_to_solution_sec\": {\"min\": %.6f, \"median\": %.6f, \"p90\": %.6f, \"max\": %.6f, \"mean\": %.6f}},\n"
+            "     \"verify_nonce\": {\"calls_per_sec\": %.1f, \"allocs_per_call\": %.4f}}%s\n",
+            r->tx_per_block, difficulty_name(r->difficulty), r->sha256_hps, r->sha256_ns,
+            r->sha256_allocs, r->pow_hps, r->pow_ns, r->pow_allocs, r->tts_min, r->tts_median,
+            r->tts_p90, r->tts_max, r->tts_mean, r->verify_per_sec, r->verify_allocs,
+            i + 1 < count ? "," : "");
+  }
+  fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char *argv[]) {
+  int tx_sizes[MAX_TX_SIZES] = {1, 10, 50, 100};
+  int num_sizes = 4;
+  int num_blocks = 20;
+  int iterations = 100000;
+  char *json_path = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:b:n:B:j:")) != -1) {
+    switch (opt) {
+      case 't': {
+        num_sizes = 0;
+        for (char *tok = strtok(optarg, ","); tok && num_sizes < MAX_TX_SIZES; tok = strtok(NULL, ","))
+          if ((tx_sizes[num_sizes] = atoi(tok)) > 0)
+            num_sizes++;
+        break;
+      }
+      case 'b':
+        num_blocks = atoi(optarg);
+        break;
+      case 'n':
+        iterations = atoi(optarg);
+        break;
+      case 'B':
+        if (!sha256_set_backend(optarg)) {
+          fprintf(stderr, "SHA-256 backend '%s' is not available on this CPU\n", optarg);
+          exit(-1);
+        }
+        break;
+      case 'j':
+        json_path = optarg;
+        break;
+      default:
+        printf("Correct format: PoWBench [-t 1,10,50] [-b blocks] [-n hashes] [-B backend] [-j file]\n");
+        exit(-1);
+    }
+  }
+  if (num_sizes == 0 || num_blocks < 1 || iterations < 1) {
+    printf("Invalid arguments\n");
+    exit(-1);
+  }
+
+  const Sha256Backend *backend = sha256_get_backend();
+  BenchResult results[MAX_TX_SIZES * 3];
+  int count = 0;
+  for (int i = 0; i < num_sizes; i++) {
+    tx_per_block = tx_sizes[i];
+    for (DifficultyLevel level = EASY; level <= HARD; level++) {
+      BenchResult *res = &results[count++];
+      memset(res, 0, sizeof(BenchResult));
+      res->tx_per_block = tx_per_block;
+      res->difficulty = level;
+      run_config(res, num_blocks, iterations);
+    }
+  }
+
+  print_table(results, count, backend);
+
+  if (json_path != NULL) {
+    FILE *out = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+    if (out == NULL) {
+      printf("Error opening %s\n", json_path);
+      exit(-1);
+    }
+    write_json(out, results, count, backend, num_blocks, iterations);
+    if (out != stdout)
+      fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,278 @@
+/* sha256.c - SHA-256 compression (FIPS 180-4) and multi-lane hashing backends */
+
+#include "sha256.h"
+
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHA256_X86 1
+#include <immintrin.h>
+#endif
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define BSIG0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BSIG1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SSIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+void sha256_init_state(uint32_t state[8]) {
+  state[0] = 0x6a09e667;
+  state[1] = 0xbb67ae85;
+  state[2] = 0x3c6ef372;
+  state[3] = 0xa54ff53a;
+  state[4] = 0x510e527f;
+  state[5] = 0x9b05688c;
+  state[6] = 0x1f83d9ab;
+  state[7] = 0x5be0cd19;
+}
+
+void sha256_compress(uint32_t state[8], const unsigned char block[SHA256_BLOCK_SIZE]) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++)
+    w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+           (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+  for (int i = 16; i < 64; i++)
+    w[i] = SSIG1(w[i - 2]) + w[i - 7] + SSIG0(w[i - 15]) + w[i - 16];
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+  for (int i = 0; i < 64; i++) {
+    uint32_t t1 = h + BSIG1(e) + CH(e, f, g) + K[i] + w[i];
+    uint32_t t2 = BSIG0(a) + MAJ(a, b, c);
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+static inline uint32_t load_be32(const unsigned char *p) {
+  return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+/* Scalar backend: one message at a time with the portable compression */
+static void compress_lanes_generic(const uint32_t midstate[8], const unsigned char *msgs,
+                                   size_t stride, size_t nblocks, uint32_t *states) {
+  uint32_t *state = states;
+  memcpy(state, midstate, 8 * sizeof(uint32_t));
+  for (size_t b = 0; b < nblocks; b++)
+    sha256_compress(state, msgs + b * SHA256_BLOCK_SIZE);
+  (void)stride;
+}
+
+#ifdef SHA256_X86
+/*
+  Multi-buffer kernel: every vector element holds the same word of a
+  different message, so the 64 rounds run on all lanes at once. The body is
+  shared by the SSE4 (4 lanes), AVX2 (8 lanes) and AVX-512 (16 lanes)
+  backends, each compiled for its own instruction set.
+*/
+#define SHA256_LANES_KERNEL(NAME, TARGET, VEC, LANES)                                  \
+  __attribute__((target(TARGET))) static void NAME(                                    \
+      const uint32_t midstate[8], const unsigned char *msgs, size_t stride,            \
+      size_t nblocks, uint32_t *states) {                                              \
+    VEC s[8], v[8], w[16];                                                             \
+    for (int k = 0; k < 8; k++) s[k] = (VEC){0} + midstate[k];                         \
+    for (size_t b = 0; b < nblocks; b++) {                                             \
+      for (int j = 0; j < 16; j++)                                                     \
+        for (int l = 0; l < LANES; l++)                                                \
+          w[j][l] = load_be32(msgs + l * stride + b * SHA256_BLOCK_SIZE + j * 4);      \
+      for (int k = 0; k < 8; k++) v[k] = s[k];                                         \
+      for (int i = 0; i < 64; i++) {                                                   \
+        if (i >= 16)                                                                   \
+          w[i & 15] += SSIG1(w[(i - 2) & 15]) + w[(i - 7) & 15] + SSIG0(w[(i - 15) & 15]); \
+        VEC t1 = v[7] + BSIG1(v[4]) + CH(v[4], v[5], v[6]) + K[i] + w[i & 15];         \
+        VEC t2 = BSIG0(v[0]) + MAJ(v[0], v[1], v[2]);                                  \
+        v[7] = v[6];                                                                   \
+        v[6] = v[5];                                                                   \
+        v[5] = v[4];                                                                   \
+        v[4] = v[3] + t1;                                                              \
+        v[3] = v[2];                                                                   \
+        v[2] = v[1];                                                                   \
+        v[1] = v[0];                                                                   \
+        v[0] = t1 + t2;                                                                \
+      }                                                                                \
+      for (int k = 0; k < 8; k++) s[k] += v[k];                                        \
+    }                                                                                  \
+    for (int l = 0; l < LANES; l++)                                                    \
+      for (int k = 0; k < 8; k++) states[l * 8 + k] = s[k][l];                         \
+  }
+
+typedef uint32_t u32x4 __attribute__((vector_size(16)));
+typedef uint32_t u32x8 __attribute__((vector_size(32)));
+typedef uint32_t u32x16 __attribute__((vector_size(64)));
+
+SHA256_LANES_KERNEL(compress_lanes_sse4, "sse4.1", u32x4, 4)
+SHA256_LANES_KERNEL(compress_lanes_avx2, "avx2", u32x8, 8)
+SHA256_LANES_KERNEL(compress_lanes_avx512, "avx512f", u32x16, 16)
+
+/* SHA-NI: the hardware rounds instructions on a single message */
+__attribute__((target("sha,sse4.1"))) static void compress_shani(uint32_t state[8],
+                                                                 const unsigned char *data) {
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);  // CDAB
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);  // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);        // CDGH
+  __m128i abef = state0, cdgh = state1;
+  __m128i m[4];
+
+  for (int i = 0; i < 16; i++) {
+    if (i < 4)
+      m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + i * 16)), mask);
+    else
+      m[i & 3] = _mm_sha256msg2_epu32(
+          _mm_add_epi32(_mm_sha256msg1_epu32(m[i & 3], m[(i + 1) & 3]),
+                        _mm_alignr_epi8(m[(i + 3) & 3], m[(i + 2) & 3], 4)),
+          m[(i + 3) & 3]);
+    __m128i msg = _mm_add_epi32(m[i & 3], _mm_loadu_si128((const __m128i *)&K[i * 4]));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+  }
+
+  state0 = _mm_add_epi32(state0, abef);
+  state1 = _mm_add_epi32(state1, cdgh);
+  tmp = _mm_shuffle_epi32(state0, 0x1B);        // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1);     // DCHG
+  _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0));  // DCBA
+  _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));     // HGFE
+}
+
+__attribute__((target("sha,sse4.1"))) static void compress_lanes_shani(
+    const uint32_t midstate[8], const unsigned char *msgs, size_t stride, size_t nblocks,
+    uint32_t *states) {
+  for (int l = 0; l < 4; l++) {
+    uint32_t *state = states + l * 8;
+    memcpy(state, midstate, 8 * sizeof(uint32_t));
+    for (size_t b = 0; b < nblocks; b++)
+      compress_shani(state, msgs + l * stride + b * SHA256_BLOCK_SIZE);
+  }
+}
+#endif
+
+/* Available backends, the generic one works on every CPU */
+static const Sha256Backend backends[] = {
+#ifdef SHA256_X86
+    {"shani", 4, compress_lanes_shani},
+    {"avx512", 16, compress_lanes_avx512},
+    {"avx2", 8, compress_lanes_avx2},
+    {"sse4", 4, compress_lanes_sse4},
+#endif
+    {"generic", 1, compress_lanes_generic},
+};
+
+static const Sha256Backend *selected_backend = NULL;
+
+static int backend_supported(const Sha256Backend *backend) {
+#ifdef SHA256_X86
+  __builtin_cpu_init();
+  if (strcmp(backend->name, "shani") == 0)
+    return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+  if (strcmp(backend->name, "avx512") == 0) return __builtin_cpu_supports("avx512f");
+  if (strcmp(backend->name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+  if (strcmp(backend->name, "sse4") == 0) return __builtin_cpu_supports("sse4.1");
+#endif
+  return strcmp(backend->name, "generic") == 0;
+}
+
+/*
+  Measures the hashes per second of a backend over a short fixed workload.
+  Which kernel wins depends on the micro-architecture (e.g. AVX-512 can be
+  faster or slower than SHA-NI), so it is measured instead of guessed.
+*/
+static double backend_hashrate(const Sha256Backend *backend) {
+  unsigned char msgs[SHA256_MAX_LANES][SHA256_BLOCK_SIZE];
+  uint32_t midstate[8], states[SHA256_MAX_LANES * 8];
+  struct timespec start, end;
+
+  memset(msgs, 0x5a, sizeof(msgs));
+  sha256_init_state(midstate);
+  int rounds = 4096 / backend->lanes;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < rounds; i++)
+    backend->compress_lanes(midstate, &msgs[0][0], SHA256_BLOCK_SIZE, 1, states);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  return elapsed > 0 ? rounds * backend->lanes / elapsed : 0;
+}
+
+const Sha256Backend *sha256_get_backend() {
+  if (selected_backend == NULL) {
+    const Sha256Backend *best = NULL;
+    double best_rate = 0;
+    int count = sizeof(backends) / sizeof(backends[0]);
+    for (int i = 0; i < count; i++) {
+      if (!backend_supported(&backends[i]))
+        continue;
+      double rate = backend_hashrate(&backends[i]);
+      if (best == NULL || rate > best_rate) {
+        best = &backends[i];
+        best_rate = rate;
+      }
+    }
+    selected_backend = best;
+  }
+  return selected_backend;
+}
+
+int sha256_set_backend(const char *name) {
+  int count = sizeof(backends) / sizeof(backends[0]);
+  for (int i = 0; i < count; i++)
+    if (strcmp(backends[i].name, name) == 0 && backend_supported(&backends[i])) {
+      selected_backend = &backends[i];
+      return 1;
+    }
+  return 0;
+}
+
+void sha256_state_to_digest(const uint32_t state[8], unsigned char digest[SHA256_DIGEST_SIZE]) {
+  for (int i = 0; i < 8; i++) {
+    digest[i * 4] = (unsigned char)(state[i] >> 24);
+    digest[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+    digest[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+    digest[i * 4 + 3] = (unsigned char)state[i];
+  }
+}
+
+size_t sha256_pad_tail(unsigned char *tail, size_t tail_len, size_t total_len) {
+  // The 0x80 marker plus the 8-byte length must fit after the data
+  size_t padded = (tail_len + 9 <= SHA256_BLOCK_SIZE) ? SHA256_BLOCK_SIZE : 2 * SHA256_BLOCK_SIZE;
+  uint64_t bits = (uint64_t)total_len * 8;
+
+  tail[tail_len] = 0x80;
+  memset(tail + tail_len + 1, 0, padded - tail_len - 1);
+  for (int i = 0; i < 8; i++)
+    tail[padded - 1 - i] = (unsigned char)(bits >> (8 * i));
+  return padded;
+}
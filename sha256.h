@@ -0,0 +1,57 @@
+/* sha256.h - SHA-256 compression primitives used by the PoW engine */
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_BLOCK_SIZE 64
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_MAX_LANES 16
+
+/*
+  Hashing backend: compresses `lanes` messages that share the same midstate.
+  Lane `l` reads `nblocks` 64-byte blocks from `msgs + l * stride` and writes
+  its final state to `states + l * 8`.
+*/
+typedef void (*sha256_lanes_fn)(const uint32_t midstate[8], const unsigned char *msgs,
+                                size_t stride, size_t nblocks, uint32_t *states);
+
+typedef struct {
+  const char *name;
+  int lanes;
+  sha256_lanes_fn compress_lanes;
+} Sha256Backend;
+
+/* Loads the SHA-256 initial hash values into `state` */
+void sha256_init_state(uint32_t state[8]);
+
+/* Runs the compression function over one 64-byte message block */
+void sha256_compress(uint32_t state[8], const unsigned char block[SHA256_BLOCK_SIZE]);
+
+/* Writes the big-endian digest that corresponds to a final `state` */
+void sha256_state_to_digest(const uint32_t state[8], unsigned char digest[SHA256_DIGEST_SIZE]);
+
+/*
+  Returns the fastest backend supported by the CPU. The supported backends
+  are timed on the first call and the choice is kept for the lifetime of the
+  process (and inherited by forked children).
+*/
+const Sha256Backend *sha256_get_backend();
+
+/*
+  Forces the backend with the given name ("generic", "sse4", "avx2",
+  "avx512", "shani"). Returns 0 if it does not exist or the CPU lacks it.
+*/
+int sha256_set_backend(const char *name);
+
+/*
+  Writes the SHA-256 padding (0x80, zeros and the 64-bit message length in
+  bits) for a message of `total_len` bytes whose last `tail_len` bytes are
+  already in `tail`. Returns the padded tail size (64 or 128 bytes), `tail`
+  must have room for 128 bytes.
+*/
+size_t sha256_pad_tail(unsigned char *tail, size_t tail_len, size_t total_len);
+
+#endif
+/* SHA256_H */
@@ -41,6 +41,14 @@ int blockchain_count;           // Total number of blocks in the Blockchain
 
 double total_verification_time; // Cumulative verification time
 
+// Wasted mining work
+int rejected_blocks;                    // Blocks mined and then rejected by the Validator
+double rejected_cpu_time;               // CPU time spent mining the rejected blocks
+unsigned long long rejected_hashes;     // Hashes computed while mining the rejected blocks
+int stale_blocks;                       // Blocks dropped while mining because the chain tip changed
+double stale_cpu_time;                  // CPU time spent on the dropped blocks
+unsigned long long stale_hashes;        // Hashes computed on the dropped blocks
+
 void statistics() {
   // Process initialization
   char msg[100];
@@ -60,6 +68,12 @@ void statistics() {
   avg_time = 0.0;
   total_block_count = 0;
   blockchain_count = 0;
+  rejected_blocks = 0;
+  rejected_cpu_time = 0.0;
+  rejected_hashes = 0;
+  stale_blocks = 0;
+  stale_cpu_time = 0.0;
+  stale_hashes = 0;
 
   Message recv;     // -> Buffer to store the messages received via message queue
 
@@ -75,20 +89,34 @@ void statistics() {
     }
     if (DEBUG)
       printf("    [Statistics] Calculating statistics...\n");
-    // -- Update the variables
-    total_block_count++;
-    int miner_index = recv.miner_id - 1;
-    if (recv.valid_block) {
-      blockchain_count++;
-      valid_blocks_per_miner[miner_index]++;
-      total_verification_time += calc_timestamp_difference(recv.creation_time, recv.validation_time);
-      avg_time = (double)(total_verification_time / blockchain_count);
-      credits_per_miner[miner_index] += recv.credits;
-    } else
-      invalid_block_per_miner[miner_index]++;
-    if (blockchain_count == blockchain_blocks) {
-      log_message("[Statistics] Blockchain Ledger is full. Closing...", 'r', 1);
-      kill(controller_pid, SIGINT);
+    // -- Stale work reported by a miner (the block never reached the Validator)
+    if (recv.msgtype == MSG_STALE_WORK) {
+      stale_blocks++;
+      stale_cpu_time += recv.results[0].mining_cpu_time;
+      stale_hashes += recv.results[0].mining_hashes;
+      continue;
+    }
+    // -- Update the variables (one result per block committed together)
+    for (int i = 0; i < recv.num_results; i++) {
+      BlockResult *result = &recv.results[i];
+      total_block_count++;
+      int miner_index = result->miner_id - 1;
+      if (result->valid_block) {
+        blockchain_count++;
+        valid_blocks_per_miner[miner_index]++;
+        total_verification_time += calc_timestamp_difference(result->creation_time, result->validation_time);
+        avg_time = (double)(total_verification_time / blockchain_count);
+        credits_per_miner[miner_index] += result->credits;
+      } else {
+        invalid_block_per_miner[miner_index]++;
+        rejected_blocks++;
+        rejected_cpu_time += result->mining_cpu_time;
+        rejected_hashes += result->mining_hashes;
+      }
+      if (result->valid_block && blockchain_count == blockchain_blocks) {
+        log_message("[Statistics] Blockchain Ledger is full. Closing...", 'r', 1);
+        kill(controller_pid, SIGINT);
+      }
     }
     if (DEBUG)
       printf("    [Statistics] Statistics calculated succesfully\n");
@@ -107,24 +135,41 @@ void print_statistics(int signum) {
   stats_in_progress = 1;
   log_message("[Statistics] Printing statistics...", 'r', 1);
   char buffer[2000];
+  char line[71];
+  char row[200];
   snprintf(buffer, sizeof(buffer),
       "\n┌────────────────────────────────────────────────────────────────────────┐\n"
       "│                             Statistics                                 │\n"
       "├────────────────────────────────────────────────────────────────────────┤\n"
       "│ Total Block Count: %-10d                                          │\n"
       "│ Blocks in the Blockchain: %-10d                                   │\n"
-      "│ Average Time to Verify: %10.2f seconds                             │\n"
+      "│ Average Time to Verify: %10.2f seconds                             │\n",
+      total_block_count, blockchain_count, avg_time
+  );
+  fprintf(log_file, buffer);
+  printf(buffer);
+
+  // Wasted mining work
+  snprintf(line, sizeof(line), "Rejected after mining: %d blocks, %.2f CPU s, %llu hashes",
+      rejected_blocks, rejected_cpu_time, rejected_hashes);
+  snprintf(row, sizeof(row), "│ %-70s │\n", line);
+  fprintf(log_file, row);
+  printf(row);
+  snprintf(line, sizeof(line), "Dropped as stale: %d blocks, %.2f CPU s, %llu hashes",
+      stale_blocks, stale_cpu_time, stale_hashes);
+  snprintf(row, sizeof(row), "│ %-70s │\n", line);
+  fprintf(log_file, row);
+  printf(row);
+
+  sprintf(buffer,
       "├────────────────────────────────────────────────────────────────────────┤\n"
       "│                          Miner Performance                             │\n"
       "├────────────┬───────────────┬────────────────┬──────────────────────────┤\n"
       "│ Miner ID   │ Valid Blocks  │ Invalid Blocks │ Total Credits            │\n"
-      "├────────────┼───────────────┼────────────────┼──────────────────────────┤\n",
-      total_block_count, blockchain_count, avg_time
-  );
+      "├────────────┼───────────────┼────────────────┼──────────────────────────┤\n");
   fprintf(log_file, buffer);
   printf(buffer);
-  
-  char row[100];
+
   for (int i = 0; i < num_miners; i++) {
     snprintf(row, sizeof(row),
         "│ %-10d │ %-13d │ %-14d │ %-21d    │\n",
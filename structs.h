@@ -8,10 +8,14 @@
 #ifndef STRUCTS_H
 #define STRUCTS_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 #define DEBUG 1
 #define TXB_ID_LEN 64
 #define PIPE_NAME "/tmp/VALIDATOR_INPUT"
 #define HASH_SIZE 65
+#define MAX_COMMIT_BATCH 16   // Max blocks a validator commits together
 
 /*
   Timestamp structure
@@ -40,17 +44,17 @@ typedef struct {
   char previous_block_hash[HASH_SIZE];
   Timestamp timestamp;
   Tx *transactions;
-  int nonce;
+  uint64_t nonce;   // 64-bit nonce, a PoW search never runs out of nonces
 } TxBlock;
 
 /*
-  Transaction Pool Node structure
+  Transaction Pool Node structure: the fields read while walking the pool,
+  the transaction itself is stored in a separate array (see tx_pool.h)
 */
 typedef struct {
-  int empty;
-  int age;
-  Tx tx;
-  int selected;
+  int epoch;        // Pool age epoch at insertion (the age is the epochs elapsed since then)
+  int reward;       // Reward as generated, aging is added on read
+  int prev, next;   // Neighbours in the base reward class bucket (-1 at the ends)
 } TxPoolNode;
 
 /*
@@ -63,19 +67,37 @@ typedef struct {
   int max_operations;
 } PoW;
 
-// Message Queue message format
+// Message Queue message types
+#define MSG_BLOCK_RESULT 1  // Validation results of the blocks committed together (sent by the Validators)
+#define MSG_STALE_WORK 2    // Block dropped while mining because the chain tip changed (sent by the Miners)
+
+// Outcome of a mined block
 typedef struct {
-  long msgtype;
   int valid_block;
   int miner_id;
   int credits;
   Timestamp creation_time;
   Timestamp validation_time;
+  double mining_cpu_time;   // CPU time spent mining the block
+  uint64_t mining_hashes;   // Hashes computed while mining the block
+} BlockResult;
+
+// Message Queue message format (only the used results are sent, see MESSAGE_SIZE)
+typedef struct {
+  long msgtype;
+  int num_results;
+  BlockResult results[MAX_COMMIT_BATCH];
 } Message;
 
+// Size argument of msgsnd() for a message with N results
+#define MESSAGE_SIZE(n) (offsetof(Message, results) - sizeof(long) + (n) * sizeof(BlockResult))
+
 typedef struct {
   int miner_id;
   char result_hash[HASH_SIZE];
+  double mining_cpu_time;
+  uint64_t mining_hashes;
+  int speculative;          // Built on the miner's own pending block (its parent may still be in validation)
   TxBlock block;
   Tx transactions[];
 } PipeMsg;
@@ -10,15 +10,221 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <sys/shm.h>
 #include <semaphore.h>
 
 #include "utils.h"
 #include "structs.h"
 #include "pow.h"
+#include "tx_pool.h"
+#include "tx_gen.h"
 
 FILE *log_file;
 
+TxRing *tx_ring;
+sem_t *tx_ring_doorbell;
+LoadConfig load;
+atomic_llong generated;         // Transactions published in load mode
+atomic_llong ring_full_waits;   // Times a producer found the ring full
+
+static void usage() {
+  printf("Correct format: TxGen <reward> <sleeptime>\n");
+  printf("            or: TxGen -r <rate> [-t threads] [-b batch] [-a uniform|poisson|bursty] [-m w1,w2,w3] [-d seconds]\n");
+  printf("  -r  target transactions per second (all threads)\n");
+  printf("  -t  producer threads (default 1, max %d)\n", MAX_GEN_THREADS);
+  printf("  -b  transactions per ring operation (default 32, max %d)\n", MAX_GEN_BATCH);
+  printf("  -a  arrival pattern (default poisson)\n");
+  printf("  -m  relative weights of the rewards 1, 2 and 3 (default 1,1,1)\n");
+  printf("  -d  seconds to run (default 0: until killed)\n");
+}
+
+static double now_sec() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void sleep_until(double t) {
+  double delay = t - now_sec();
+  if (delay <= 0)
+    return;
+  struct timespec ts;
+  ts.tv_sec = (time_t)delay;
+  ts.tv_nsec = (long)((delay - ts.tv_sec) * 1e9);
+  nanosleep(&ts, NULL);
+}
+
+/*
+  Exponentially distributed gap (s) between arrivals at the given rate
+*/
+static double exponential_gap(unsigned int *seed, double rate) {
+  double u = (rand_r(seed) + 1.0) / (RAND_MAX + 2.0);  // -> (0, 1)
+  return -log(u) / rate;
+}
+
+static int pick_reward(unsigned int *seed) {
+  int total = load.reward_mix[0] + load.reward_mix[1] + load.reward_mix[2];
+  int r = rand_r(seed) % total;
+  for (int i = 0; i < 2; i++) {
+    if (r < load.reward_mix[i])
+      return i + 1;
+    r -= load.reward_mix[i];
+  }
+  return 3;
+}
+
+/*
+  Publishes a batch on the ingestion ring, waiting while it is full (up to
+  `end`, if not 0). Returns how many were published.
+*/
+static int publish(const Tx *txs, int count, double end) {
+  int done = 0;
+  while (done < count) {
+    int n = tx_ring_push_batch(tx_ring, txs + done, count - done);
+    if (n == 0) {
+      atomic_fetch_add(&ring_full_waits, 1);
+      if (end != 0 && now_sec() >= end)
+        break;
+      usleep(1000);  // -> Ring full (the pool is full too): wait for the Controller to drain it
+      continue;
+    }
+    done += n;
+    tx_ring_wake_consumer(tx_ring, tx_ring_doorbell);
+  }
+  return done;
+}
+
+/*
+  Load mode producer thread: generates its share of the target rate and
+  publishes every transaction that is due in one ring operation
+*/
+static void *producer_routine(void *arg) {
+  int thread = *(int*)arg;
+  unsigned int seed = time(NULL) ^ (getpid() << 8) ^ (thread * 7919);
+  double rate = load.rate / load.threads;
+  Tx batch[MAX_GEN_BATCH];
+  memset(batch, 0, sizeof(batch));
+  int seq = 0;
+
+  double next = now_sec();
+  double end = load.duration > 0 ? next + load.duration : 0;
+  while (end == 0 || next < end) {
+    sleep_until(next);
+    double now = now_sec();
+    Timestamp current_time = get_timestamp();
+
+    // -- Every transaction due by now (a whole batch for bursts)
+    int count = 0;
+    while (count < load.batch && (next <= now || (load.pattern == ARRIVAL_BURSTY && count > 0))) {
+      Tx *tx = &batch[count++];
+      sprintf(tx->id, "TX-%d-%d-%d", getpid(), thread, ++seq);
+      tx->reward = pick_reward(&seed);
+      tx->value = rand_r(&seed) % 100 + 1;
+      tx->timestamp = current_time;
+      if (load.pattern == ARRIVAL_POISSON)
+        next += exponential_gap(&seed, rate);
+      else if (load.pattern == ARRIVAL_UNIFORM)
+        next += 1 / rate;
+      else if (count == load.batch)
+        next += exponential_gap(&seed, rate / load.batch);
+    }
+    atomic_fetch_add(&generated, publish(batch, count, end));
+  }
+  return NULL;
+}
+
+/*
+  Runs the load mode: several producer threads at a target rate, with a
+  rate report every second
+*/
+static void run_load_mode() {
+  static const char *patterns[] = {"uniform", "poisson", "bursty"};
+  char msg[200];
+  sprintf(msg, "[Tx Gen] [PID %d] Load mode: %.0f tx/s, %d threads, batch %d, %s arrivals, reward mix %d,%d,%d",
+          getpid(), load.rate, load.threads, load.batch, patterns[load.pattern], load.reward_mix[0],
+          load.reward_mix[1], load.reward_mix[2]);
+  log_message(msg, 'r', 1);
+
+  pthread_t thread_id[MAX_GEN_THREADS];
+  int thread_num[MAX_GEN_THREADS];
+  for (int i = 0; i < load.threads; i++) {
+    thread_num[i] = i;
+    pthread_create(&thread_id[i], NULL, producer_routine, &thread_num[i]);
+  }
+
+  double start = now_sec();
+  long long last = 0;
+  for (int elapsed = 1; load.duration == 0 || elapsed <= load.duration; elapsed++) {
+    sleep_until(start + elapsed);
+    long long total = atomic_load(&generated);
+    printf("[Tx Gen] [PID %d] %lld tx/s (%lld total, ring full %lld times)\n", getpid(), total - last, total,
+           (long long)atomic_load(&ring_full_waits));
+    last = total;
+  }
+
+  for (int i = 0; i < load.threads; i++)
+    pthread_join(thread_id[i], NULL);
+  sprintf(msg, "[Tx Gen] [PID %d] Load mode generated %lld transactions in %.1f s", getpid(),
+          (long long)atomic_load(&generated), now_sec() - start);
+  log_message(msg, 'r', 1);
+}
+
+/*
+  Parses the load mode options, returns 0 if any is invalid
+*/
+static int parse_load_options(int argc, char *argv[]) {
+  load.rate = 0;
+  load.threads = 1;
+  load.batch = 32;
+  load.duration = 0;
+  load.pattern = ARRIVAL_POISSON;
+  load.reward_mix[0] = load.reward_mix[1] = load.reward_mix[2] = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "r:t:b:a:m:d:")) != -1) {
+    switch (opt) {
+      case 'r':
+        load.rate = atof(optarg);
+        break;
+      case 't':
+        load.threads = atoi(optarg);
+        break;
+      case 'b':
+        load.batch = atoi(optarg);
+        break;
+      case 'a':
+        if (strcmp(optarg, "uniform") == 0)
+          load.pattern = ARRIVAL_UNIFORM;
+        else if (strcmp(optarg, "poisson") == 0)
+          load.pattern = ARRIVAL_POISSON;
+        else if (strcmp(optarg, "bursty") == 0)
+          load.pattern = ARRIVAL_BURSTY;
+        else
+          return 0;
+        break;
+      case 'm':
+        if (sscanf(optarg, "%d,%d,%d", &load.reward_mix[0], &load.reward_mix[1], &load.reward_mix[2]) != 3)
+          return 0;
+        break;
+      case 'd':
+        load.duration = atoi(optarg);
+        break;
+      default:
+        return 0;
+    }
+  }
+  if (optind != argc || load.rate <= 0 || load.threads < 1 || load.threads > MAX_GEN_THREADS ||
+      load.batch < 1 || load.batch > MAX_GEN_BATCH || load.duration < 0)
+    return 0;
+  for (int i = 0; i < 3; i++)
+    if (load.reward_mix[i] < 0)
+      return 0;
+  return load.reward_mix[0] + load.reward_mix[1] + load.reward_mix[2] > 0;
+}
+
 int main(int argc, char *argv[]) {
   // Open the log file
   log_file = fopen("DEIChain_log.txt", "a");
@@ -28,22 +234,23 @@ int main(int argc, char *argv[]) {
   }
 
   // Verify the given arguments
-  if (argc != 3) {
+  int load_mode = argc > 1 && argv[1][0] == '-';
+  if ((!load_mode && argc != 3) || (load_mode && !parse_load_options(argc, argv))) {
     log_message("[Tx Gen] Error creating a Transaction Generator", 'w', 1);
-    printf("Correct format: TxGen <reward> <sleeptime>\n");
+    usage();
     exit(-1);
   }
 
   // Assign the arguments to the respective variables
-  int reward;
-  int sleeptime;
+  int reward = 0;
+  int sleeptime = 0;
   int error_flag = 0;
-  if ((reward = convert_to_int(argv[1])) == 0 || reward < 1 || reward > 3) {
+  if (!load_mode && ((reward = convert_to_int(argv[1])) == 0 || reward < 1 || reward > 3)) {
     log_message("[Tx Gen] Invalid reward parameter", 'w', 1);
     printf("reward: 1 to 3\n");
     error_flag = 1;
   }
-  if ((sleeptime = convert_to_int(argv[2])) == 0 || sleeptime < 200 || sleeptime > 3000) {
+  if (!load_mode && ((sleeptime = convert_to_int(argv[2])) == 0 || sleeptime < 200 || sleeptime > 3000)) {
     log_message("[Tx Gen] Invalid sleep time parameter", 'w', 1);
     printf("sleeptime (ms): 200 to 3000\n");
     error_flag = 1;
@@ -55,30 +262,17 @@ int main(int argc, char *argv[]) {
   char msg[100];
   sprintf(msg, "[Tx Gen] [PID %d] Process initialized", getpid());
   log_message(msg, 'r', DEBUG);
-  sprintf(msg, "[Tx Gen] [PID %d] reward = %d", getpid(), reward);
-  log_message(msg, 'r', DEBUG);
-  sprintf(msg, "[Tx Gen] [PID %d] sleeptime = %d", getpid(), sleeptime);
-  log_message(msg, 'r', DEBUG);
-
-  // Open the Transaction Pool related semaphores
-  sem_t *tx_pool_mutex = sem_open("TX_POOL_MUTEX", 0);
-  if (tx_pool_mutex == SEM_FAILED) {
-    printf("\x1b[31m[!]\x1b[0m tx_pool_mutex not initialized yet. The Controller process has not been launched. Closing.\n");
-    exit(-1);
-  }
-  sem_t *tx_pool_full = sem_open("TX_POOL_FULL", 0);
-  if (tx_pool_full == SEM_FAILED) {
-    printf("\x1b[31m[!]\x1b[0m tx_pool_full not initialized yet. The Controller process has not been launched. Closing.\n");
-    exit(-1);
-  }
-  sem_t *tx_pool_empty = sem_open("TX_POOL_EMPTY", 0);
-  if (tx_pool_empty == SEM_FAILED) {
-    printf("\x1b[31m[!]\x1b[0m tx_pool_empty not initialized yet. The Controller process has not been launched. Closing.\n");
-    exit(-1);
+  if (!load_mode) {
+    sprintf(msg, "[Tx Gen] [PID %d] reward = %d", getpid(), reward);
+    log_message(msg, 'r', DEBUG);
+    sprintf(msg, "[Tx Gen] [PID %d] sleeptime = %d", getpid(), sleeptime);
+    log_message(msg, 'r', DEBUG);
   }
-  sem_t *check_occupancy = sem_open("CHECK_OCCUPANCY", 0);
-  if (check_occupancy == SEM_FAILED) {
-    printf("\x1b[31m[!]\x1b[0m check_occupancy not initialized yet. The Controller process has not been launched. Closing.\n");
+
+  // Open the ingestion ring's doorbell (the pool itself is only locked by the Controller)
+  tx_ring_doorbell = sem_open("TX_RING_DOORBELL", 0);
+  if (tx_ring_doorbell == SEM_FAILED) {
+    printf("\x1b[31m[!]\x1b[0m tx_ring_doorbell not initialized yet. The Controller process has not been launched. Closing.\n");
     exit(-1);
   }
 
@@ -95,8 +289,8 @@ int main(int argc, char *argv[]) {
     printf("[TxGen] [PID %d] Successfully accessed the Transaction Pool (Shared Memory)\n", getpid());
 
   // -- Attach to the shared memory
-  TxPoolNode *tx_pool;
-  if ((tx_pool = (TxPoolNode*)shmat(tx_pool_id, NULL, 0)) < 0) {
+  TxPoolHeader *tx_pool_header;
+  if ((tx_pool_header = (TxPoolHeader*)shmat(tx_pool_id, NULL, 0)) == (void*)-1) {
     printf("[TxGen] [PID %d] Error attaching to the Transaction Pool (Shared Memory)\n", getpid());
     exit(-1);
 	}
@@ -106,12 +300,17 @@ int main(int argc, char *argv[]) {
   }
 
 
-  // -- Get the size of Transaction Pool
-  struct shmid_ds buf;
-  shmctl(tx_pool_id, IPC_STAT, &buf);
-  int tx_pool_size = (int)buf.shm_segsz / sizeof(TxPoolNode);
+  // -- Get the size of Transaction Pool and the ingestion ring
+  tx_ring = get_tx_ring(tx_pool_header);
+  int tx_pool_size = tx_pool_header->size;
   printf("[TxGen] [PID %d] tx_pool_size = %d\n", getpid(), tx_pool_size);
 
+  if (load_mode) {
+    run_load_mode();
+    shmdt(tx_pool_header);
+    return 0;
+  }
+
   int increment = 1;
   while (1) {
     // Generate a transaction
@@ -126,26 +325,21 @@ int main(int argc, char *argv[]) {
     printf("[Tx Gen] [PID %d] Timestamp = %02d:%02d:%02d\n", getpid(), current_time.hour, current_time.min, current_time.sec);
 
     // Write the transaction in shared memory
-    // -- Find the first empty slot in the Transaction Pool
-    sem_wait(tx_pool_empty);
-    sem_wait(tx_pool_mutex);
+    // -- Publish it on the ingestion ring, the Controller moves it into the pool
     if (DEBUG)
-      printf("[Tx Gen] [PID %d] Writing the transaction to the Transaction Pool...\n", getpid());
-    int i = 0;
-    while (tx_pool[i].empty != 1) {
-      i = (i + 1) % tx_pool_size;
-    }
-    strcpy(tx_pool[i].tx.id, id);
-    tx_pool[i].tx.reward = reward;
-    tx_pool[i].tx.value = value;
-    tx_pool[i].tx.timestamp = current_time;
-    tx_pool[i].empty = 0;
-    sem_post(tx_pool_mutex);
-    sem_post(tx_pool_full);
+      printf("[Tx Gen] [PID %d] Writing the transaction to the ingestion ring...\n", getpid());
+    Tx tx;
+    memset(&tx, 0, sizeof(Tx));
+    strcpy(tx.id, id);
+    tx.reward = reward;
+    tx.value = value;
+    tx.timestamp = current_time;
+    while (!tx_ring_push(tx_ring, &tx))
+      usleep(1000);  // -> Ring full (the pool is full too): wait for the Controller to drain it
+    tx_ring_wake_consumer(tx_ring, tx_ring_doorbell);
     if (DEBUG)
-      printf("[Tx Gen] [PID %d] Transaction successfully written to the Transaction Pool.\n", getpid());
-    sem_post(check_occupancy);  // -> Unblock the Validator Manager to check the pool's occupancy
-    sleep(sleeptime); // -- TODO: revert the sleep time back to 'sleeptime'
+      printf("[Tx Gen] [PID %d] Transaction successfully written to the ingestion ring.\n", getpid());
+    usleep(sleeptime * 1000);  // -> sleeptime is in ms
   }
 
   // Process termination
@@ -8,6 +8,31 @@
 #ifndef TX_GEN_H
 #define TX_GEN_H
 
+#define MAX_GEN_THREADS 64      // Max producer threads in load mode
+#define MAX_GEN_BATCH 256       // Max transactions published per ring operation
 
+/*
+  Arrival patterns of the load mode (same average rate)
+    ARRIVAL_UNIFORM -> evenly spaced transactions
+    ARRIVAL_POISSON -> exponential gaps between transactions
+    ARRIVAL_BURSTY  -> whole batches at once, exponential gaps between them
+*/
+typedef enum {
+  ARRIVAL_UNIFORM,
+  ARRIVAL_POISSON,
+  ARRIVAL_BURSTY
+} ArrivalPattern;
+
+/*
+  Load mode settings (TxGen -r <rate> ...)
+*/
+typedef struct {
+  double rate;              // Target transactions per second (all threads)
+  int threads;              // Producer threads
+  int batch;                // Transactions per ring operation
+  int duration;             // Seconds to run, 0 runs until killed
+  ArrivalPattern pattern;
+  int reward_mix[3];        // Relative weights of the rewards 1, 2 and 3
+} LoadConfig;
 
 #endif
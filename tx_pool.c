@@ -0,0 +1,656 @@
+/*
+  DEIChain - Transaction Pool Source Code
+  by
+    Samuel Riça (2023206471)
+    Diogo Santos (2023211097)
+
+  This file contains the shared memory layout of the Transactions Pool
+  (shards, bitmaps, ID indexes, reward class buckets and ingestion ring) and
+  the operations on it.
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <time.h>
+
+#include "tx_pool.h"
+
+#define ALIGN(x, a) (((x) + (a) - 1) / (a) * (a))
+#define BITMAP_WORDS(n) (((n) + 63) / 64)
+
+
+/*
+  Auxiliary function to compute the number of entries of a shard's ID index:
+  a power of two with at least twice as many entries as slots
+*/
+static int get_tx_index_capacity(int shard_size) {
+  int capacity = 16;
+  while (capacity < 2 * shard_size)
+    capacity *= 2;
+  return capacity;
+}
+
+
+/*
+  Auxiliary function to compute the shared memory layout of the pool. The
+  offsets are written to `header` if it is not NULL. Returns the total size.
+*/
+static size_t layout_tx_pool(TxPoolHeader *header, int size, int ring_size, int num_shards) {
+  size_t offset = ALIGN(sizeof(TxPoolHeader) + sizeof(TxPoolShard) * num_shards, 64);
+  int first_slot = 0;
+  for (int i = 0; i < num_shards; i++) {
+    int shard_size = size / num_shards + (i < size % num_shards);
+    // -- Each shard's bitmaps start on their own cache line: they are written
+    //    under the shard's lock only
+    size_t bitmap_size = sizeof(uint64_t) * BITMAP_WORDS(shard_size);
+    if (header != NULL) {
+      header->shards[i].first_slot = first_slot;
+      header->shards[i].size = shard_size;
+      header->shards[i].index_mask = get_tx_index_capacity(shard_size) - 1;
+      header->shards[i].occupied_offset = offset;
+      header->shards[i].leased_offset = offset + bitmap_size;
+    }
+    offset += 2 * bitmap_size;
+    if (header != NULL)
+      header->shards[i].index_offset = offset;
+    offset = ALIGN(offset + sizeof(TxIndexEntry) * get_tx_index_capacity(shard_size), 64);
+    first_slot += shard_size;
+  }
+
+  size_t nodes_offset = offset;
+  size_t payloads_offset = ALIGN(nodes_offset + sizeof(TxPoolNode) * size, 64);
+  size_t leases_offset = ALIGN(payloads_offset + sizeof(Tx) * size, 64);
+  size_t ring_offset = ALIGN(leases_offset + sizeof(TxLease) * size, 64);
+  if (header != NULL) {
+    header->nodes_offset = nodes_offset;
+    header->payloads_offset = payloads_offset;
+    header->leases_offset = leases_offset;
+    header->ring_offset = ring_offset;
+  }
+  return ring_offset + sizeof(TxRing) + sizeof(TxRingCell) * ring_size;
+}
+
+
+static uint64_t *get_occupied_bitmap(TxPoolShard *shard, TxPoolHeader *header) {
+  return (uint64_t*)((char*)header + shard->occupied_offset);
+}
+
+static uint64_t *get_leased_bitmap(TxPoolShard *shard, TxPoolHeader *header) {
+  return (uint64_t*)((char*)header + shard->leased_offset);
+}
+
+static TxLease *get_tx_leases(TxPoolHeader *header) {
+  return (TxLease*)((char*)header + header->leases_offset);
+}
+
+static TxIndexEntry *get_tx_index(TxPoolShard *shard, TxPoolHeader *header) {
+  return (TxIndexEntry*)((char*)header + shard->index_offset);
+}
+
+
+/*
+  FNV-1a hash of a transaction ID
+*/
+static uint32_t hash_tx_id(const char *id) {
+  uint32_t hash = 2166136261u;
+  for (; *id; id++)
+    hash = (hash ^ (unsigned char)*id) * 16777619u;
+  return hash;
+}
+
+
+size_t get_tx_pool_size(int pool_size, int ring_size, int num_shards) {
+  return layout_tx_pool(NULL, pool_size, ring_size, num_shards);
+}
+
+
+TxPoolNode *get_tx_pool_mapping(TxPoolHeader *header) {
+  return (TxPoolNode*)((char*)header + header->nodes_offset);
+}
+
+
+Tx *get_tx_pool_payloads(TxPoolHeader *header) {
+  return (Tx*)((char*)header + header->payloads_offset);
+}
+
+
+TxRing *get_tx_ring(TxPoolHeader *header) {
+  return (TxRing*)((char*)header + header->ring_offset);
+}
+
+
+int get_reward_class(int reward) {
+  if (reward < 1)
+    return 0;
+  return (reward < NUM_REWARD_CLASSES ? reward : NUM_REWARD_CLASSES) - 1;
+}
+
+
+TxPoolShard *get_tx_home_shard(TxPoolHeader *header, const char *id) {
+  return &header->shards[hash_tx_id(id) % header->num_shards];
+}
+
+
+void init_tx_pool(TxPoolHeader *header, int size, int ring_size, int num_shards) {
+  atomic_init(&header->age_epoch, 0);
+  header->size = size;
+  header->ring_size = ring_size;
+  header->num_shards = num_shards;
+  layout_tx_pool(header, size, ring_size, num_shards);
+
+  memset(get_tx_pool_mapping(header), 0, sizeof(TxPoolNode) * size);
+
+  for (int s = 0; s < num_shards; s++) {
+    TxPoolShard *shard = &header->shards[s];
+    sem_init(&shard->mutex, 1, 1);
+    shard->free_count = shard->size;
+    shard->free_hint = 0;
+    int words = BITMAP_WORDS(shard->size);
+    uint64_t *occupied = get_occupied_bitmap(shard, header);
+    memset(occupied, 0, sizeof(uint64_t) * words);
+    memset(get_leased_bitmap(shard, header), 0, sizeof(uint64_t) * words);
+    if (shard->size % 64 != 0)
+      occupied[words - 1] = ~0ULL << (shard->size % 64);  // -> Bits past the last slot are never free
+    TxIndexEntry *index = get_tx_index(shard, header);
+    for (int i = 0; i <= shard->index_mask; i++)
+      index[i].slot = -1;
+
+    atomic_init(&shard->overflow, 0);
+    atomic_init(&shard->occupied, 0);
+    shard->age_epoch = 0;
+    for (int i = 0; i < NUM_REWARD_CLASSES; i++) {
+      atomic_init(&shard->reward_count[i], 0);
+      shard->bucket_head[i] = -1;
+      shard->bucket_tail[i] = -1;
+      for (int c = 0; c < NUM_REWARD_CLASSES; c++)
+        shard->promote_cursor[i][c] = -1;
+    }
+  }
+
+  // -- Empty ingestion ring: cell i is ready for the i-th push
+  TxRing *ring = get_tx_ring(header);
+  atomic_init(&ring->enqueue_pos, 0);
+  atomic_init(&ring->dequeue_pos, 0);
+  atomic_init(&ring->consumer_waiting, 0);
+  ring->mask = ring_size - 1;
+  for (int i = 0; i < ring_size; i++)
+    atomic_init(&ring->cells[i].sequence, i);
+}
+
+
+/*
+  Auxiliary functions to link and unlink a slot in its base reward class
+  bucket. A new transaction is the youngest of the shard, so it always goes
+  to the tail.
+*/
+static void link_tx(TxPoolShard *shard, TxPoolNode *tx_pool, int slot, int base) {
+  int after = shard->bucket_tail[base];
+  tx_pool[slot].prev = after;
+  tx_pool[slot].next = -1;
+  if (after >= 0)
+    tx_pool[after].next = slot;
+  else
+    shard->bucket_head[base] = slot;
+  shard->bucket_tail[base] = slot;
+}
+
+static void unlink_tx(TxPoolShard *shard, TxPoolNode *tx_pool, int slot, int base) {
+  TxPoolNode *node = &tx_pool[slot];
+  if (node->prev >= 0)
+    tx_pool[node->prev].next = node->next;
+  else
+    shard->bucket_head[base] = node->next;
+  if (node->next >= 0)
+    tx_pool[node->next].prev = node->prev;
+  else
+    shard->bucket_tail[base] = node->prev;
+}
+
+
+int tx_shard_age(const TxPoolShard *shard, const TxPoolNode *node) {
+  return shard->age_epoch - node->epoch;
+}
+
+
+int tx_shard_reward(const TxPoolShard *shard, const TxPoolNode *node) {
+  return node->reward + tx_shard_age(shard, node) / AGING_PERIOD;
+}
+
+
+/*
+  Auxiliary function to take the lowest free slot of a shard (word level
+  scan of the occupancy bitmap), -1 if the shard is full
+*/
+static int take_free_slot(TxPoolShard *shard, TxPoolHeader *header) {
+  if (shard->free_count == 0)
+    return -1;
+  uint64_t *occupied = get_occupied_bitmap(shard, header);
+  int words = BITMAP_WORDS(shard->size);
+  for (int w = shard->free_hint; w < words; w++)
+    if (~occupied[w] != 0) {
+      int bit = __builtin_ctzll(~occupied[w]);
+      occupied[w] |= 1ULL << bit;
+      shard->free_hint = w;
+      shard->free_count--;
+      return shard->first_slot + w * 64 + bit;
+    }
+  return -1;
+}
+
+
+/*
+  Auxiliary function to set or clear the lease bit of a slot
+*/
+static void set_leased(TxPoolShard *shard, TxPoolHeader *header, int slot, int leased) {
+  int i = slot - shard->first_slot;
+  uint64_t *word = &get_leased_bitmap(shard, header)[i / 64];
+  if (leased)
+    *word |= 1ULL << (i % 64);
+  else
+    *word &= ~(1ULL << (i % 64));
+}
+
+
+int tx_shard_leased(TxPoolShard *shard, TxPoolHeader *header, int slot, long long now) {
+  int i = slot - shard->first_slot;
+  if (((get_leased_bitmap(shard, header)[i / 64] >> (i % 64)) & 1) == 0)
+    return 0;
+  return get_tx_leases(header)[slot].expiry > now;
+}
+
+
+void tx_shard_sync_age(TxPoolShard *shard, TxPoolHeader *header, TxPoolNode *tx_pool) {
+  int epoch = atomic_load(&header->age_epoch);
+  if (epoch == shard->age_epoch)
+    return;
+  shard->age_epoch = epoch;
+
+  // -- Advance every cursor past the transactions that reached its class. The
+  //    lower classes go first, so a transaction that skips a class still
+  //    moves through the counters one class at a time.
+  for (int base = 0; base < NUM_REWARD_CLASSES; base++)
+    for (int class = base + 1; class < NUM_REWARD_CLASSES; class++) {
+      int *cursor = &shard->promote_cursor[base][class];
+      while (*cursor >= 0 && get_reward_class(tx_shard_reward(shard, &tx_pool[*cursor])) >= class) {
+        atomic_fetch_sub(&shard->reward_count[class - 1], 1);
+        atomic_fetch_add(&shard->reward_count[class], 1);
+        *cursor = tx_pool[*cursor].next;
+      }
+    }
+}
+
+
+int tx_shard_insert(TxPoolShard *shard, TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *tx) {
+  int slot = take_free_slot(shard, header);
+  if (slot < 0)
+    return -1;
+  tx_shard_sync_age(shard, header, tx_pool);
+  int base = get_reward_class(tx->reward);
+  get_tx_pool_payloads(header)[slot] = *tx;
+  tx_pool[slot].epoch = shard->age_epoch;
+  tx_pool[slot].reward = tx->reward;
+  set_leased(shard, header, slot, 0);
+  link_tx(shard, tx_pool, slot, base);
+  for (int class = base + 1; class < NUM_REWARD_CLASSES; class++)
+    if (shard->promote_cursor[base][class] < 0)
+      shard->promote_cursor[base][class] = slot;  // -> Every older transaction already reached the class
+  atomic_fetch_add(&shard->reward_count[base], 1);
+  atomic_fetch_add(&shard->occupied, 1);
+
+  // -- Index the transaction ID
+  TxIndexEntry *index = get_tx_index(shard, header);
+  uint32_t hash = hash_tx_id(tx->id);
+  int i = hash & shard->index_mask;
+  while (index[i].slot != -1)
+    i = (i + 1) & shard->index_mask;
+  index[i].hash = hash;
+  index[i].slot = slot;
+  return slot;
+}
+
+
+/*
+  Auxiliary function to get the index entry of a transaction ID, -1 if the
+  transaction is not in the shard
+*/
+static int find_tx_entry(TxPoolShard *shard, TxPoolHeader *header, const char *id) {
+  TxIndexEntry *index = get_tx_index(shard, header);
+  Tx *payloads = get_tx_pool_payloads(header);
+  uint32_t hash = hash_tx_id(id);
+  for (int i = hash & shard->index_mask; index[i].slot != -1; i = (i + 1) & shard->index_mask)
+    if (index[i].hash == hash && strcmp(payloads[index[i].slot].id, id) == 0)
+      return i;
+  return -1;
+}
+
+
+int tx_shard_find(TxPoolShard *shard, TxPoolHeader *header, TxPoolNode *tx_pool, const char *id) {
+  int entry = find_tx_entry(shard, header, id);
+  return entry < 0 ? -1 : get_tx_index(shard, header)[entry].slot;
+}
+
+
+void tx_shard_remove(TxPoolShard *shard, TxPoolHeader *header, TxPoolNode *tx_pool, int slot) {
+  tx_shard_sync_age(shard, header, tx_pool);
+  TxIndexEntry *index = get_tx_index(shard, header);
+  int mask = shard->index_mask;
+  int i = find_tx_entry(shard, header, get_tx_pool_payloads(header)[slot].id);
+
+  // -- Backward shift deletion: move up the entries of the same probe run
+  //    that would no longer be reachable once the entry is emptied
+  for (int j = (i + 1) & mask; i >= 0 && index[j].slot != -1; j = (j + 1) & mask) {
+    int home = index[j].hash & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      index[i] = index[j];
+      i = j;
+    }
+  }
+  if (i >= 0)
+    index[i].slot = -1;
+
+  // -- Cursors on the transaction move to the next (younger) one, which has
+  //    not reached the class either
+  int base = get_reward_class(tx_pool[slot].reward);
+  for (int class = base + 1; class < NUM_REWARD_CLASSES; class++)
+    if (shard->promote_cursor[base][class] == slot)
+      shard->promote_cursor[base][class] = tx_pool[slot].next;
+
+  unlink_tx(shard, tx_pool, slot, base);
+  int w = (slot - shard->first_slot) / 64;
+  get_occupied_bitmap(shard, header)[w] &= ~(1ULL << ((slot - shard->first_slot) % 64));
+  if (w < shard->free_hint)
+    shard->free_hint = w;
+  shard->free_count++;
+  atomic_fetch_sub(&shard->reward_count[get_reward_class(tx_shard_reward(shard, &tx_pool[slot]))], 1);
+  atomic_fetch_sub(&shard->occupied, 1);
+}
+
+
+int tx_pool_insert_batch(TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *txs, int count) {
+  int inserted = 0;
+  for (int start = 0; start < count; start += TX_RING_BATCH) {
+    int n = count - start < TX_RING_BATCH ? count - start : TX_RING_BATCH;
+    const Tx *batch = txs + start;
+    int home[TX_RING_BATCH];
+    int placed[TX_RING_BATCH];
+    for (int i = 0; i < n; i++) {
+      home[i] = hash_tx_id(batch[i].id) % header->num_shards;
+      placed[i] = 0;
+    }
+
+    // -- Lock each home shard once for all of its transactions
+    for (int s = 0; s < header->num_shards; s++) {
+      TxPoolShard *shard = &header->shards[s];
+      int locked = 0;
+      for (int i = 0; i < n; i++) {
+        if (home[i] != s)
+          continue;
+        if (!locked) {
+          sem_wait(&shard->mutex);
+          locked = 1;
+        }
+        placed[i] = tx_shard_insert(shard, header, tx_pool, &batch[i]) >= 0;
+      }
+      if (locked)
+        sem_post(&shard->mutex);
+    }
+
+    // -- Transactions whose shard is full go to the next shard with room
+    for (int i = 0; i < n; i++) {
+      for (int k = 1; !placed[i] && k < header->num_shards; k++) {
+        TxPoolShard *shard = &header->shards[(home[i] + k) % header->num_shards];
+        sem_wait(&shard->mutex);
+        placed[i] = tx_shard_insert(shard, header, tx_pool, &batch[i]) >= 0;
+        sem_post(&shard->mutex);
+        if (placed[i])
+          atomic_fetch_add(&header->shards[home[i]].overflow, 1);
+      }
+      inserted += placed[i];
+    }
+  }
+  return inserted;
+}
+
+
+typedef enum {
+  LOOKUP_FIND,
+  LOOKUP_REMOVE,
+  LOOKUP_LEASE,
+  LOOKUP_RELEASE
+} LookupAction;
+
+/*
+  Auxiliary function to find a transaction and apply an action to it: its
+  own shard is checked first, the others only if some of its transactions
+  overflowed. Returns 0 if the transaction is not in the pool or the action
+  failed (leased to another owner).
+*/
+static int lookup_tx(TxPoolHeader *header, TxPoolNode *tx_pool, const char *id, LookupAction action,
+                     int owner, long long expiry) {
+  int home = hash_tx_id(id) % header->num_shards;
+  for (int k = 0; k < header->num_shards; k++) {
+    if (k == 1 && atomic_load(&header->shards[home].overflow) == 0)
+      break;
+    TxPoolShard *shard = &header->shards[(home + k) % header->num_shards];
+    sem_wait(&shard->mutex);
+    int slot = tx_shard_find(shard, header, tx_pool, id);
+    int done = slot >= 0;
+    if (slot >= 0) {
+      TxLease *lease = &get_tx_leases(header)[slot];
+      switch (action) {
+        case LOOKUP_FIND:
+          break;
+        case LOOKUP_REMOVE:
+          tx_shard_remove(shard, header, tx_pool, slot);
+          if (k > 0)
+            atomic_fetch_sub(&header->shards[home].overflow, 1);
+          break;
+        case LOOKUP_LEASE:
+          // -- Taken over once expired, renewed if already held by the owner
+          if (tx_shard_leased(shard, header, slot, tx_lease_clock()) && lease->owner != owner) {
+            done = 0;
+            break;
+          }
+          lease->owner = owner;
+          lease->expiry = expiry;
+          set_leased(shard, header, slot, 1);
+          break;
+        case LOOKUP_RELEASE:
+          if (lease->owner == owner)
+            set_leased(shard, header, slot, 0);
+          break;
+      }
+    }
+    sem_post(&shard->mutex);
+    if (slot >= 0)
+      return done;
+  }
+  return 0;
+}
+
+
+int tx_pool_contains(TxPoolHeader *header, TxPoolNode *tx_pool, const char *id) {
+  return lookup_tx(header, tx_pool, id, LOOKUP_FIND, 0, 0);
+}
+
+
+int tx_pool_remove(TxPoolHeader *header, TxPoolNode *tx_pool, const char *id) {
+  return lookup_tx(header, tx_pool, id, LOOKUP_REMOVE, 0, 0);
+}
+
+
+int tx_pool_remove_batch(TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *txs, int count) {
+  int removed = 0;
+  for (int start = 0; start < count; start += TX_RING_BATCH) {
+    int n = count - start < TX_RING_BATCH ? count - start : TX_RING_BATCH;
+    const Tx *batch = txs + start;
+    int home[TX_RING_BATCH];
+    int found[TX_RING_BATCH];
+    for (int i = 0; i < n; i++) {
+      home[i] = hash_tx_id(batch[i].id) % header->num_shards;
+      found[i] = 0;
+    }
+
+    // -- Lock each home shard once for all of its transactions
+    for (int s = 0; s < header->num_shards; s++) {
+      TxPoolShard *shard = &header->shards[s];
+      int locked = 0;
+      for (int i = 0; i < n; i++) {
+        if (home[i] != s)
+          continue;
+        if (!locked) {
+          sem_wait(&shard->mutex);
+          locked = 1;
+        }
+        int slot = tx_shard_find(shard, header, tx_pool, batch[i].id);
+        if (slot >= 0) {
+          tx_shard_remove(shard, header, tx_pool, slot);
+          found[i] = 1;
+        }
+      }
+      if (locked)
+        sem_post(&shard->mutex);
+    }
+
+    // -- Transactions that overflowed to another shard
+    for (int i = 0; i < n; i++) {
+      if (!found[i] && atomic_load(&header->shards[home[i]].overflow) > 0)
+        found[i] = lookup_tx(header, tx_pool, batch[i].id, LOOKUP_REMOVE, 0, 0);
+      removed += found[i];
+    }
+  }
+  return removed;
+}
+
+
+long long tx_lease_clock() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+
+int tx_pool_lease(TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *txs, int count, int owner, int duration_ms) {
+  long long expiry = tx_lease_clock() + duration_ms;
+  for (int i = 0; i < count; i++)
+    if (!lookup_tx(header, tx_pool, txs[i].id, LOOKUP_LEASE, owner, expiry)) {
+      tx_pool_release(header, tx_pool, txs, i, owner);
+      return 0;
+    }
+  return 1;
+}
+
+
+void tx_pool_release(TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *txs, int count, int owner) {
+  for (int i = 0; i < count; i++)
+    lookup_tx(header, tx_pool, txs[i].id, LOOKUP_RELEASE, owner, 0);
+}
+
+
+void increment_age(TxPoolHeader *header) {
+  atomic_fetch_add(&header->age_epoch, 1);
+}
+
+
+int tx_pool_occupancy(TxPoolHeader *header) {
+  int occupied = 0;
+  for (int s = 0; s < header->num_shards; s++)
+    occupied += atomic_load(&header->shards[s].occupied);
+  return occupied;
+}
+
+
+int tx_pool_reward_count(TxPoolHeader *header, int class) {
+  int count = 0;
+  for (int s = 0; s < header->num_shards; s++)
+    count += atomic_load(&header->shards[s].reward_count[class]);
+  return count;
+}
+
+
+int tx_ring_push(TxRing *ring, const Tx *tx) {
+  unsigned int pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+  while (1) {
+    TxRingCell *cell = &ring->cells[pos & ring->mask];
+    int diff = (int)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - pos);
+    if (diff == 0) {
+      // -- Cell is free for this position => claim it
+      if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        cell->tx = *tx;
+        atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+        return 1;
+      }
+    }
+    else if (diff < 0)
+      return 0;  // -> The cell still holds the transaction of the previous lap: ring full
+    else
+      pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+  }
+}
+
+
+int tx_ring_push_batch(TxRing *ring, const Tx *txs, int count) {
+  unsigned int pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+  while (1) {
+    // -- Count the free cells from this position on
+    int n = 0;
+    while (n < count) {
+      TxRingCell *cell = &ring->cells[(pos + n) & ring->mask];
+      if ((int)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - (pos + n)) != 0)
+        break;
+      n++;
+    }
+    if (n == 0) {
+      TxRingCell *cell = &ring->cells[pos & ring->mask];
+      if ((int)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - pos) < 0)
+        return 0;  // -> Ring full
+      pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+      continue;
+    }
+
+    // -- Claim the whole run, the cells stay free since no other producer can claim them
+    if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos, pos + n,
+                                              memory_order_relaxed, memory_order_relaxed)) {
+      for (int i = 0; i < n; i++) {
+        TxRingCell *cell = &ring->cells[(pos + i) & ring->mask];
+        cell->tx = txs[i];
+        atomic_store_explicit(&cell->sequence, pos + i + 1, memory_order_release);
+      }
+      return n;
+    }
+  }
+}
+
+
+int tx_ring_pop_batch(TxRing *ring, Tx *txs, int max) {
+  int count = 0;
+  unsigned int pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+  while (count < max) {
+    TxRingCell *cell = &ring->cells[pos & ring->mask];
+    int diff = (int)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - (pos + 1));
+    if (diff == 0) {
+      // -- Cell holds the transaction for this position => claim it
+      if (atomic_compare_exchange_weak_explicit(&ring->dequeue_pos, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        txs[count++] = cell->tx;
+        atomic_store_explicit(&cell->sequence, pos + ring->mask + 1, memory_order_release);
+        pos++;
+      }
+    }
+    else if (diff < 0)
+      break;     // -> Ring empty
+    else
+      pos = atomic_load_explicit(&ring->dequeue_pos, memory_order_relaxed);
+  }
+  return count;
+}
+
+
+void tx_ring_wake_consumer(TxRing *ring, sem_t *doorbell) {
+  atomic_thread_fence(memory_order_seq_cst);  // -> Order the push before reading the flag
+  if (atomic_load_explicit(&ring->consumer_waiting, memory_order_relaxed) &&
+      atomic_exchange(&ring->consumer_waiting, 0))
+    sem_post(doorbell);
+}
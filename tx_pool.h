@@ -0,0 +1,239 @@
+/*
+  DEIChain - Transaction Pool Header File
+  by
+    Samuel Riça (2023206471)
+    Diogo Santos (2023211097)
+*/
+
+#ifndef TX_POOL_H
+#define TX_POOL_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <semaphore.h>
+
+#include "structs.h"
+
+#define NUM_REWARD_CLASSES 3  // Rewards 1, 2 and 3 or more (aging raises rewards above 3)
+#define TX_RING_BATCH 256     // Max transactions moved from the ingestion ring per batch
+#define AGING_PERIOD 50       // A transaction's reward goes up by one every AGING_PERIOD ages
+
+/*
+  Transaction Pool shard. Each shard owns a contiguous range of slots, with
+  its own lock, occupancy and lease bitmaps, transaction ID index and
+  reward class buckets, so operations on different shards never contend.
+  A transaction belongs to the shard given by the hash of its ID and is
+  only stored in another shard if its own is full.
+*/
+typedef struct {
+  _Alignas(64) sem_t mutex;   // Protects the shard's slots, index and buckets (process shared)
+  int first_slot;             // First slot of the shard in the nodes array
+  int size;                   // Number of slots of the shard
+  int free_count;             // Number of free slots
+  int free_hint;              // Bitmap word the free slot search starts at (the ones before are full)
+  int index_mask;             // Number of index entries - 1 (power of two)
+  size_t occupied_offset;     // Offset of the occupancy bitmap from the pool header
+  size_t leased_offset;       // Offset of the lease bitmap from the pool header
+  size_t index_offset;        // Offset of the ID index from the pool header
+  atomic_int overflow;        // Transactions of this shard stored in other shards
+  atomic_int occupied;                            // Number of occupied slots
+  atomic_int reward_count[NUM_REWARD_CLASSES];    // Occupied slots per (aged) reward class
+  int bucket_head[NUM_REWARD_CLASSES];  // Oldest transaction of each base reward class (-1 if none)
+  int bucket_tail[NUM_REWARD_CLASSES];  // Newest transaction of each base reward class (-1 if none)
+  int age_epoch;                        // Pool epoch the shard's classes and counters are synced to
+  int promote_cursor[NUM_REWARD_CLASSES][NUM_REWARD_CLASSES];  // [base][class] Oldest transaction
+                                        // of the bucket still below the class (-1 if none), class > base
+} TxPoolShard;
+
+/*
+  Transaction Pool header, placed at the start of the pool's shared memory
+  and followed by the shards, their bitmaps and ID indexes, the TxPoolNode
+  array, the transaction (payload) array, the lease array and the
+  transaction ingestion ring. The pool is a structure of arrays: slot i is
+  bit i of the bitmaps, node i, transaction i and lease i, so walks over
+  the buckets and slot searches never bring whole transactions into the
+  cache. The occupied slots of a shard are linked in one bucket per base
+  reward class, ordered from the oldest to the newest transaction. The
+  occupancy counters are updated under the shard locks but can be read
+  without them (the reward class counters of a shard lag behind the epoch
+  until the shard is next locked).
+*/
+typedef struct {
+  atomic_int age_epoch;   // Aging epoch, advanced by increment_age()
+  int size;               // Number of slots in the pool
+  int ring_size;          // Number of cells in the ingestion ring (power of two)
+  int num_shards;         // Number of shards
+  size_t nodes_offset;    // Offset of the TxPoolNode array
+  size_t payloads_offset; // Offset of the Tx array
+  size_t leases_offset;   // Offset of the TxLease array
+  size_t ring_offset;     // Offset of the ingestion ring
+  TxPoolShard shards[];
+} TxPoolHeader;
+
+/*
+  Lease of a pool slot, valid while its bit is set in the shard's lease
+  bitmap and the expiry has not passed
+*/
+typedef struct {
+  int owner;            // Miner thread holding the lease
+  long long expiry;     // tx_lease_clock() value the lease expires at
+} TxLease;
+
+/*
+  Entry of a shard's transaction ID index (open addressing, linear probing)
+*/
+typedef struct {
+  uint32_t hash;      // Hash of the transaction ID
+  int slot;           // Pool slot of the transaction, -1 if the entry is empty
+} TxIndexEntry;
+
+/*
+  Cell of the transaction ingestion ring
+*/
+typedef struct {
+  atomic_uint sequence;   // Position the cell is ready for (written by producers and consumers)
+  Tx tx;
+} TxRingCell;
+
+/*
+  Transaction ingestion ring: bounded lock-free MPMC queue (one sequence
+  number per cell) written by the Transaction Generators and drained into
+  the pool by the Controller. The positions live on separate cache lines so
+  producers and the consumer do not false share.
+*/
+typedef struct {
+  _Alignas(64) atomic_uint enqueue_pos;
+  _Alignas(64) atomic_uint dequeue_pos;
+  _Alignas(64) atomic_int consumer_waiting;   // Set while the consumer sleeps on TX_RING_DOORBELL
+  unsigned int mask;                          // Number of cells - 1
+  TxRingCell cells[];
+} TxRing;
+
+/*
+  Computes the size of the Transaction Pool's shared memory
+*/
+size_t get_tx_pool_size(int pool_size, int ring_size, int num_shards);
+
+/*
+  Lays out and initializes the Transaction Pool's shared memory: every slot
+  empty and free, empty ingestion ring (`ring_size` must be a power of two)
+*/
+void init_tx_pool(TxPoolHeader *header, int size, int ring_size, int num_shards);
+
+/*
+  Get the addresses of the nodes array, the transactions array and the
+  ingestion ring
+*/
+TxPoolNode *get_tx_pool_mapping(TxPoolHeader *header);
+Tx *get_tx_pool_payloads(TxPoolHeader *header);
+TxRing *get_tx_ring(TxPoolHeader *header);
+
+/*
+  Returns the reward class (bucket and reward_count index) of a reward
+*/
+int get_reward_class(int reward);
+
+/*
+  Returns the shard a transaction ID belongs to
+*/
+TxPoolShard *get_tx_home_shard(TxPoolHeader *header, const char *id);
+
+/*
+  Shard level operations, must be called with the shard's mutex held
+    tx_shard_sync_age() -> catches the shard up with the pool's aging epoch
+                           (promotes the transactions that changed class)
+    tx_shard_insert()   -> copies a transaction to a free slot of the shard
+                           and indexes it, returns the slot or -1 if the
+                           shard is full
+    tx_shard_find()     -> returns the slot of a transaction ID, or -1
+    tx_shard_remove()   -> empties a slot and gives it back to the shard
+    tx_shard_leased()   -> returns 1 if a slot is leased at time `now`
+    tx_shard_age()      -> age of a transaction at the shard's epoch
+    tx_shard_reward()   -> reward of a transaction at the shard's epoch
+  Insert and remove sync the shard first, direct bucket walks must call
+  tx_shard_sync_age() themselves.
+*/
+void tx_shard_sync_age(TxPoolShard *shard, TxPoolHeader *header, TxPoolNode *tx_pool);
+int tx_shard_insert(TxPoolShard *shard, TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *tx);
+int tx_shard_find(TxPoolShard *shard, TxPoolHeader *header, TxPoolNode *tx_pool, const char *id);
+void tx_shard_remove(TxPoolShard *shard, TxPoolHeader *header, TxPoolNode *tx_pool, int slot);
+int tx_shard_leased(TxPoolShard *shard, TxPoolHeader *header, int slot, long long now);
+int tx_shard_age(const TxPoolShard *shard, const TxPoolNode *node);
+int tx_shard_reward(const TxPoolShard *shard, const TxPoolNode *node);
+
+/*
+  Inserts a batch of transactions, locking every shard at most once (plus
+  the shards that take the overflow of full shards). The caller must have
+  reserved the slots (tx_pool_empty). Returns the number inserted.
+*/
+int tx_pool_insert_batch(TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *txs, int count);
+
+/*
+  Checks if a transaction is in the pool (locks the shards it may be in)
+*/
+int tx_pool_contains(TxPoolHeader *header, TxPoolNode *tx_pool, const char *id);
+
+/*
+  Removes a transaction from the pool, returns 0 if it was not there
+*/
+int tx_pool_remove(TxPoolHeader *header, TxPoolNode *tx_pool, const char *id);
+
+/*
+  Removes a batch of transactions, locking every home shard at most once.
+  Returns the number removed.
+*/
+int tx_pool_remove_batch(TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *txs, int count);
+
+/*
+  Transaction leases. A miner leases the transactions of the block it
+  mines, so the other miners (and its own next blocks) skip them until the
+  block is added to the ledger (the transactions leave the pool), rejected
+  or dropped (released), or the lease expires.
+    tx_lease_clock()  -> monotonic clock in milliseconds, shared by every process
+    tx_pool_lease()   -> leases every transaction to `owner` for `duration_ms`,
+                         all or nothing: returns 0 and leases none if one of
+                         them is gone or leased to another owner
+    tx_pool_release() -> releases the transactions leased to `owner`
+*/
+long long tx_lease_clock();
+int tx_pool_lease(TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *txs, int count, int owner, int duration_ms);
+void tx_pool_release(TxPoolHeader *header, TxPoolNode *tx_pool, const Tx *txs, int count, int owner);
+
+/*
+  Aging mechanism of the Transactions Pool: one step for every transaction,
+  O(1) (the shards catch up lazily)
+*/
+void increment_age(TxPoolHeader *header);
+
+/*
+  Lock free readers of the occupancy counters (sum over the shards)
+*/
+int tx_pool_occupancy(TxPoolHeader *header);
+int tx_pool_reward_count(TxPoolHeader *header, int class);
+
+/*
+  Publishes a transaction on the ingestion ring without locking. Returns 0 if
+  the ring is full. Call tx_ring_wake_consumer() afterwards.
+*/
+int tx_ring_push(TxRing *ring, const Tx *tx);
+
+/*
+  Publishes up to `count` transactions on the ingestion ring, claiming the
+  free cells with one atomic operation. Returns how many were published (0
+  if the ring is full), in order.
+*/
+int tx_ring_push_batch(TxRing *ring, const Tx *txs, int count);
+
+/*
+  Takes up to `max` transactions from the ingestion ring without locking,
+  returns how many were copied to `txs`
+*/
+int tx_ring_pop_batch(TxRing *ring, Tx *txs, int max);
+
+/*
+  Posts the ring's doorbell semaphore if the consumer is sleeping on it
+*/
+void tx_ring_wake_consumer(TxRing *ring, sem_t *doorbell);
+
+#endif
@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 #include <signal.h>
 #include <sys/ipc.h>
 #include <sys/wait.h>
@@ -49,7 +50,7 @@ void log_message(char *msg, char msg_type, int verbose) {
   int year = local->tm_year + 1900;  // year since 1900
 
   // Log the message to the log file
-  sem_wait(log_mutex);
+  while (sem_wait(log_mutex) == -1 && errno == EINTR);  // -> Signals (SIGUSR2, SIGTERM) must not skip the lock
   
   // -- Write the log message to the log file
   fprintf(log_file, "[%02d/%02d/%d - %02d:%02d:%02d] %s\n", day, month, year, hours, minutes, seconds, msg);
@@ -108,6 +109,56 @@ void load_config(int *num_miners, int *tx_pool_size, int *transactions_per_block
 }
 
 
+/*
+  Reads an optional "NAME=VALUE" setting from the configuration file. Only the
+  lines after the four mandatory values are considered
+*/
+int load_config_option(char *name, char *value, int size) {
+  char buffer[BUFFER_SIZE];
+  FILE *config_file;
+  if ((config_file = fopen("config.cfg", "r")) == NULL)
+    return 0;
+
+  int line = 0, found = 0;
+  while (!found && fgets(buffer, BUFFER_SIZE, config_file) != NULL) {
+    if (line++ < 4)
+      continue;
+    buffer[strcspn(buffer, "\r\n")] = '\0';   // Remove the '\n' character
+
+    char *separator = strchr(buffer, '=');
+    if (separator == NULL)
+      continue;
+    *separator = '\0';
+    if (strcmp(buffer, name) == 0) {
+      snprintf(value, size, "%s", separator + 1);
+      found = 1;
+    }
+  }
+
+  fclose(config_file);
+  return found;
+}
+
+
+/*
+  Reads an optional numeric setting from the configuration file
+*/
+int load_config_int(char *name, int default_value) {
+  char value[BUFFER_SIZE];
+  if (!load_config_option(name, value, sizeof(value)))
+    return default_value;
+
+  int res = convert_to_int(value);
+  if (res == 0 && strcmp(value, "0") != 0) {
+    char msg[BUFFER_SIZE + 50];
+    snprintf(msg, sizeof(msg), "Invalid value for %s, using %d", name, default_value);
+    log_message(msg, 'w', 1);
+    return default_value;
+  }
+  return res;
+}
+
+
 /*
   Auxiliary function to convert a number in the string format to an integer
 */
@@ -147,11 +198,21 @@ Timestamp get_timestamp() {
 }
 
 
+/*
+  Auxiliary function to compute the size of the Blockchain Ledger's shared memory
+*/
+size_t get_blockchain_size(int num_blocks, int tx_per_block) {
+  size_t size = (sizeof(TxBlock) + sizeof(Tx) * tx_per_block) * num_blocks + HASH_SIZE;
+  size = (size + sizeof(atomic_uint) - 1) / sizeof(atomic_uint) * sizeof(atomic_uint);  // -> Align the epoch
+  return size + sizeof(atomic_uint);
+}
+
+
 /*
   Auxiliary function to get the memory addresses of the blocks and the
   respective transactions in shared memory
 */
-void get_blockchain_mapping(TxBlock *blockchain_ledger, int num_blocks, int tx_per_block, TxBlock **blocks, char **last_hash) {
+void get_blockchain_mapping(TxBlock *blockchain_ledger, int num_blocks, int tx_per_block, TxBlock **blocks, char **last_hash, atomic_uint **tip_epoch) {
   // Cursor with the shared memory's address
   char *cursor = (char*)blockchain_ledger;
   
@@ -166,6 +227,9 @@ void get_blockchain_mapping(TxBlock *blockchain_ledger, int num_blocks, int tx_p
   // Assign the last validated hash string
   *last_hash = cursor;
 
+  // Assign the chain tip epoch (placed at the end of the shared memory)
+  *tip_epoch = (atomic_uint*)((char*)blockchain_ledger + get_blockchain_size(num_blocks, tx_per_block) - sizeof(atomic_uint));
+
   // Map each block's transactions array
   for (int i = 0; i < num_blocks; i++)
     (*blocks)[i].transactions = transactions + i * tx_per_block;
@@ -212,14 +276,14 @@ void dump_ledger(TxBlock *blocks, int num_blocks, int tx_per_block) {
         "│ Previous Hash:                                                         │\n"
         "│   %-69s│\n"
         "│ Block Timestamp: %02d:%02d:%02d                                              │\n"
-        "│ Nonce: %-10d                                                      │\n"
+        "│ Nonce: %-10llu                                                      │\n"
         "├────────────────────────────────────────────────────────────────────────┤\n"
         "│                          Transactions                                  │\n"
         "├────────────────────┬──────────────┬───────────────┬────────────────────┤\n"
         "│ TX ID              │ Reward       │ Value         │ Timestamp          │\n"
         "├────────────────────┼──────────────┼───────────────┼────────────────────┤\n",
         i, block->id, block->previous_block_hash, block->timestamp.hour, block->timestamp.min,
-        block->timestamp.sec, block->nonce
+        block->timestamp.sec, (unsigned long long)block->nonce
     );
     fprintf(log_file, buffer);
     printf(buffer);
@@ -256,14 +320,14 @@ void print_block(TxBlock block, int tx_per_block) {
       "│ Previous Hash:                                                         │\n"
       "│   %-69s│\n"
       "│ Block Timestamp: %02d:%02d:%02d                                              │\n"
-      "│ Nonce: %-10d                                                      │\n"
+      "│ Nonce: %-10llu                                                      │\n"
       "├────────────────────────────────────────────────────────────────────────┤\n"
       "│                          Transactions                                  │\n"
       "├────────────────────┬──────────────┬───────────────┬────────────────────┤\n"
       "│ TX ID              │ Reward       │ Value         │ Timestamp          │\n"
       "├────────────────────┼──────────────┼───────────────┼────────────────────┤\n",
       0, block.id, block.previous_block_hash, block.timestamp.hour, block.timestamp.min,
-      block.timestamp.sec, block.nonce
+      block.timestamp.sec, (unsigned long long)block.nonce
   );
   printf(buffer);
   // Print Transactions for the Block
@@ -278,18 +342,3 @@ void print_block(TxBlock block, int tx_per_block) {
   sprintf(buffer, "└────────────────────┴──────────────┴───────────────┴────────────────────┘\n");
   printf(buffer);
 }
-
-/*
-  Auxiliary function that implements the aging mechanism of the Transactions Pool
-*/
-void increment_age(TxPoolNode *tx_pool, int size) {
-  TxPoolNode *cur;
-  for (int i = 0; i < size; i++) {
-    cur = &tx_pool[i];
-    if (cur->empty == 0) {
-      cur->age++;
-      if (cur->age % 50 == 0)
-        cur->tx.reward++;
-    }
-  }
-}
\ No newline at end of file
@@ -11,6 +11,9 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdatomic.h>
+#include <stddef.h>
+
 #include "structs.h"
 
 /*
@@ -25,6 +28,19 @@ void log_message(char* message, char msg_type, int verbose);
 */
 void load_config(int *num_miners, int *tx_pool_size, int *transactions_per_block, int *blockchain_blocks);
 
+/*
+  Function to read an optional "NAME=VALUE" setting written after the four
+  mandatory lines of the configuration file. Returns 1 if the setting exists,
+  copying its value to VALUE
+*/
+int load_config_option(char *name, char *value, int size);
+
+/*
+  Function to read an optional numeric setting of the configuration file,
+  returning DEFAULT_VALUE when it is missing or invalid
+*/
+int load_config_int(char *name, int default_value);
+
 /*
   Auxiliary function to convert a number written as a string to an integer
 */
@@ -35,11 +51,18 @@ int convert_to_int(char *str);
 */
 Timestamp get_timestamp();
 
+/*
+  Auxiliary function to compute the size of the Blockchain Ledger's shared
+  memory (blocks, transactions, last hash and chain tip epoch)
+*/
+size_t get_blockchain_size(int num_blocks, int tx_per_block);
+
 /*
   Auxiliary function to get the memory addresses of the blocks and the
-  respective transactions in shared memory
+  respective transactions in shared memory, as well as the hash of the last
+  block and the chain tip epoch (incremented every time a block is added)
 */
-void get_blockchain_mapping(TxBlock *blockchain_ledger, int num_blocks, int tx_per_block, TxBlock **blocks, char **last_hash);
+void get_blockchain_mapping(TxBlock *blockchain_ledger, int num_blocks, int tx_per_block, TxBlock **blocks, char **last_hash, atomic_uint **tip_epoch);
 
 /*
   Auxiliar function to dump the data from the Blockchain Ledger
@@ -51,9 +74,4 @@ void dump_ledger(TxBlock *blocks, int num_blocks, int tx_per_block);
 */
 void print_block(TxBlock block, int tx_per_block);
 
-/*
-  Auxiliary function that implements the aging mechanism of the Transactions Pool
-*/
-void increment_age(TxPoolNode *tx_pool, int size);
-
 #endif
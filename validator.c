@@ -6,7 +6,11 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <signal.h>
 #include <fcntl.h>
@@ -16,189 +20,497 @@
 #include "utils.h"
 #include "validator.h"
 #include "pow.h"
+#include "tx_pool.h"
+#include "block_ring.h"
+#include "block_frame.h"
+#include "alloc_stats.h"
 
 #define BUF_SIZE 200
+#define SPECULATIVE_WAIT 200  // Max time (ms) a speculative block waits for its parent
 
 extern int tx_per_block;
 extern int tx_pool_size;
 extern int blockchain_blocks;
+extern int block_transport;
+extern int validator_threads;
+extern int commit_batch;
+extern int commit_window_ms;
+extern TxPoolHeader *tx_pool_header;
 extern TxPoolNode *tx_pool;
 extern TxBlock *blocks;
 extern TxBlock *blockchain_ledger;
+extern BlockRing *block_ring;
 
 extern sem_t *ledger_mutex;
-extern sem_t *tx_pool_mutex;
 extern sem_t *tx_pool_empty;
 extern sem_t *pipe_mutex;
+extern sem_t *pipe_read_mutex;
 extern sem_t *hash_mutex;
 extern sem_t *check_occupancy;
 
 extern int msq_id;
 
 extern char *last_hash;
+extern atomic_uint *tip_epoch;
+
+/*
+  A block going through the validation pipeline of a validator process
+*/
+typedef struct {
+  PipeMsg *recv;            // Block as received (ring slot, or copy of the frame)
+  PipeMsg *buffer;          // Copy of the frame (FIFO transport)
+  unsigned int slot_pos;    // Block ring slot, released once the block is committed
+  int pow_valid;            // Result of the PoW stage
+  int verified;             // Set once the PoW stage is done with the block
+  char hash[HASH_SIZE];     // Hash computed by the PoW stage
+} ValidationJob;
+
+/*
+  Validation pipeline: blocks go through three stages connected by the
+  circular job array, in the order they were read
+    intake (1 thread)                  -> reads the blocks from the block ring or the named pipe
+    PoW stage (validator_threads)      -> verifies the blocks' PoW in parallel
+    commit stage (the process' thread) -> chain and pool checks, ledger and pool updates,
+                                          for groups of up to commit_batch blocks
+  Job sequence numbers: [committed, next_verify) are verified or being
+  verified, [next_verify, taken) wait for a PoW thread.
+*/
+pthread_mutex_t pipeline_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t job_taken = PTHREAD_COND_INITIALIZER;      // A block was read (PoW threads wait)
+pthread_cond_t job_verified = PTHREAD_COND_INITIALIZER;   // A PoW was verified (commit stage waits)
+pthread_cond_t job_committed = PTHREAD_COND_INITIALIZER;  // A job is free again (intake waits)
+ValidationJob *jobs;
+unsigned int pipeline_depth;
+unsigned long long jobs_taken = 0;
+unsigned long long jobs_next_verify = 0;
+unsigned long long jobs_committed = 0;
+int pipeline_closed = 0;    // Set when the named pipe is closed, the stages finish their jobs and stop
+
+/*
+  Set by SIGTERM (sent by the Validator Manager to stop an auxiliary
+  validator): the intake stops reading, the blocks already read are
+  validated and their ring slots released before the process exits
+*/
+volatile sig_atomic_t validator_stop = 0;
+
+static void stop_validator(int signum) {
+  validator_stop = 1;
+}
+
+typedef struct {
+  int id;
+  int fd;
+} IntakeArgs;
+
+/*
+  Intake stage: reads the blocks in arrival order into free jobs
+*/
+static void *intake_routine(void *arg) {
+  IntakeArgs *args = (IntakeArgs*)arg;
+  int id = args->id;
+  char msg[BUF_SIZE];
+
+  // -- The intake is the only thread SIGTERM interrupts
+  sigset_t stop_signal;
+  sigemptyset(&stop_signal);
+  sigaddset(&stop_signal, SIGTERM);
+  pthread_sigmask(SIG_UNBLOCK, &stop_signal, NULL);
+
+  FrameReader reader;
+  size_t payload_size = sizeof(PipeMsg) + tx_per_block * sizeof(Tx);
+  if (block_transport == TRANSPORT_FIFO)
+    frame_reader_init(&reader, payload_size);
+
+  while (1) {
+    // -- Wait for a free job
+    pthread_mutex_lock(&pipeline_mutex);
+    while (jobs_taken - jobs_committed == pipeline_depth)
+      pthread_cond_wait(&job_committed, &pipeline_mutex);
+    pthread_mutex_unlock(&pipeline_mutex);
+    ValidationJob *job = &jobs[jobs_taken % pipeline_depth];
+
+    if (block_transport == TRANSPORT_RING)
+      job->recv = block_ring_take(block_ring, &job->slot_pos, &validator_stop);  // -> Validated in place, blocks while the ring is empty
+    else {
+      // Take the next frame read (the ones already read are validated even when stopping),
+      // or read a batch of frames from the named pipe (blocking state while waiting)
+      PipeMsg *recv;
+      int dropped = 0, bytes = 1;
+      while ((recv = frame_reader_next(&reader, &dropped)) == NULL &&
+             (bytes = frame_reader_fill(&reader, args->fd, pipe_read_mutex, &validator_stop)) > 0);
+      if (dropped > 0) {
+        sprintf(msg, "[Validator %d] Dropped %d damaged frames from the named pipe", id, dropped);
+        log_message(msg, 'w', 1);
+      }
+
+      if (bytes == FRAME_STOPPED)
+        break;
+      else if (bytes < 0) {
+        sprintf(msg, "[Validator %d] Error reading from the named pipe", id);
+        log_message(msg, 'w', 1);
+        continue;
+      }
+      else if (bytes == 0) {
+        sprintf(msg, "[Validator %d] Named pipe is closed", id);
+        log_message(msg, 'w', 1);
+        break;
+      }
+      memcpy(job->buffer, recv, payload_size);  // -> The reader's buffer is reused by the next read
+      job->recv = job->buffer;
+    }
+    if (job->recv == NULL)
+      break;  // -> Stopped while waiting for a block
+    job->verified = 0;
+
+    sprintf(msg, "[Validator %d] Received block %s for validation from miner %d", id, job->recv->block.id, job->recv->miner_id);
+    log_message(msg, 'r', 1);
+
+    pthread_mutex_lock(&pipeline_mutex);
+    jobs_taken++;
+    pthread_cond_signal(&job_taken);
+    pthread_mutex_unlock(&pipeline_mutex);
+  }
+
+  if (validator_stop) {
+    sprintf(msg, "[Validator %d] Stopping: validating the blocks already read", id);
+    log_message(msg, 'r', DEBUG);
+  }
+  if (block_transport == TRANSPORT_FIFO)
+    frame_reader_free(&reader);
+  pthread_mutex_lock(&pipeline_mutex);
+  pipeline_closed = 1;
+  pthread_cond_broadcast(&job_taken);
+  pthread_cond_broadcast(&job_verified);
+  pthread_mutex_unlock(&pipeline_mutex);
+  return NULL;
+}
+
+/*
+  PoW stage: hashes each block once with its claimed nonce
+*/
+static void *verify_routine(void *arg) {
+  pow_thread_init();  // -> Every buffer is allocated before the first block
+
+  pthread_mutex_lock(&pipeline_mutex);
+  while (1) {
+    while (jobs_next_verify == jobs_taken && !pipeline_closed)
+      pthread_cond_wait(&job_taken, &pipeline_mutex);
+    if (jobs_next_verify == jobs_taken)
+      break;  // -> Closed and nothing left to verify
+    ValidationJob *job = &jobs[jobs_next_verify++ % pipeline_depth];
+    pthread_mutex_unlock(&pipeline_mutex);
+
+    TxBlock block = job->recv->block;
+    block.transactions = job->recv->transactions;
+    job->pow_valid = verify_nonce(&block, job->hash) && strcmp(job->recv->result_hash, job->hash) == 0;
+
+    pthread_mutex_lock(&pipeline_mutex);
+    job->verified = 1;
+    pthread_cond_signal(&job_verified);
+  }
+  pthread_mutex_unlock(&pipeline_mutex);
+  return NULL;
+}
+
+/*
+  Auxiliary function to wait for the next group of blocks to commit: every
+  consecutive verified job, up to commit_batch. Blocks already read are
+  waited for (their PoW is being verified), new arrivals only during the
+  commit window. Returns 0 once the pipeline is closed and empty.
+*/
+static int gather_batch() {
+  struct timespec deadline;
+  int count = 0, window_open = 0, timed_out = 0;
+  pthread_mutex_lock(&pipeline_mutex);
+  while (1) {
+    while (count < commit_batch && jobs_committed + count < jobs_taken &&
+           jobs[(jobs_committed + count) % pipeline_depth].verified)
+      count++;
+    if (count == commit_batch)
+      break;
+    if (jobs_committed + count < jobs_taken) {
+      pthread_cond_wait(&job_verified, &pipeline_mutex);  // -> Already read, its PoW is being verified
+      continue;
+    }
+    if (pipeline_closed || (count > 0 && (commit_window_ms == 0 || timed_out)))
+      break;
+
+    if (count == 0)
+      pthread_cond_wait(&job_verified, &pipeline_mutex);
+    else {
+      // -- Give the blocks arriving within the commit window a chance to join the group
+      if (!window_open) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += commit_window_ms * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        window_open = 1;
+      }
+      timed_out = pthread_cond_timedwait(&job_verified, &pipeline_mutex, &deadline) == ETIMEDOUT;
+    }
+  }
+  pthread_mutex_unlock(&pipeline_mutex);
+  return count;
+}
+
+/*
+  Auxiliary function to check if a transaction belongs to a block accepted
+  earlier in the same group (its removal from the pool is still pending)
+*/
+static int in_group(const Tx *group_txs, int count, const char *id) {
+  for (int i = 0; i < count; i++)
+    if (strcmp(group_txs[i].id, id) == 0)
+      return 1;
+  return 0;
+}
 
 void validator(int id) {
   // Process initialization
   signal(SIGINT, SIG_IGN);  // -> Ignore SIGINT, since auxiliary validator processes will inherit SIGINT handling
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = stop_validator;  // -> No SA_RESTART, the intake's waits are interrupted
+  sigaction(SIGTERM, &act, NULL);
   char msg[BUF_SIZE];
   sprintf(msg, "[Validator %d] Process initialized (PID -> %d | parent PID -> %d)", id, getpid(), getppid());
   log_message(msg, 'r', DEBUG);
 
-  int fd = open(PIPE_NAME, O_RDONLY);
-  if (fd < 0) {
+  int fd = block_transport == TRANSPORT_FIFO ? open(PIPE_NAME, O_RDONLY) : -1;
+  if (block_transport == TRANSPORT_FIFO && fd < 0) {
     sprintf(msg, "[Validator %d] Error opening the named pipe", id);
     log_message(msg, 'w', 1);
     return;
   }
+  if (block_transport == TRANSPORT_FIFO) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);  // -> Opened blocking first, so it waits for the miners' end
+    sprintf(msg, "[Validator %d] Successfully opened the named pipe", id);
+    log_message(msg, 'r', DEBUG);
+  }
 
   // Re-map shared memory to get consistent pointers
   TxBlock *blocks;
   char *last_hash;
-  get_blockchain_mapping(blockchain_ledger, blockchain_blocks, tx_per_block, &blocks, &last_hash);
+  atomic_uint *tip_epoch;
+  get_blockchain_mapping(blockchain_ledger, blockchain_blocks, tx_per_block, &blocks, &last_hash, &tip_epoch);
 
-  sprintf(msg, "[Validator %d] Successfully opened the named pipe", id);
-  log_message(msg, 'r', DEBUG);
-
-  while (1) {
-    PipeMsg *recv = malloc(sizeof(PipeMsg) + tx_per_block * sizeof(Tx));
+  // Set up the pipeline: enough jobs to keep every PoW thread busy while a group of blocks is committed
+  pipeline_depth = commit_batch + 2 * validator_threads;
+  jobs = (ValidationJob*)calloc(pipeline_depth, sizeof(ValidationJob));
+  if (block_transport == TRANSPORT_FIFO)
+    for (unsigned int i = 0; i < pipeline_depth; i++)
+      jobs[i].buffer = (PipeMsg*)malloc(sizeof(PipeMsg) + tx_per_block * sizeof(Tx));
 
-    // Read a block from the named pipe (blocking state while waiting)
-    int bytes = read(fd, recv, sizeof(PipeMsg) + tx_per_block * sizeof(Tx));
-  
-    int is_valid = 1;
+  // -- Only the intake receives SIGTERM, the other threads' locks and waits are never interrupted
+  sigset_t stop_signal;
+  sigemptyset(&stop_signal);
+  sigaddset(&stop_signal, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &stop_signal, NULL);
 
-    if (bytes < 0) {
-      sprintf(msg, "[Validator %d] Error reading from the named pipe", id);
-      log_message(msg, 'w', 1);
-      free(recv);
-      continue;
-    }
-    else if (bytes == 0) {
-      sprintf(msg, "[Validator %d] Named pipe is closed", id);
-      log_message(msg, 'w', 1);
-      free(recv);
-      break;
-    }
+  IntakeArgs intake_args = {id, fd};
+  pthread_t intake_id, verify_id[validator_threads];
+  int num_verify = 0;
+  if (pthread_create(&intake_id, NULL, intake_routine, &intake_args) != 0) {
+    sprintf(msg, "[Validator %d] Error creating the intake thread", id);
+    log_message(msg, 'w', 1);
+    exit(-1);
+  }
+  for (int i = 0; i < validator_threads; i++)
+    if (pthread_create(&verify_id[num_verify], NULL, verify_routine, NULL) == 0)
+      num_verify++;
+  if (num_verify == 0) {
+    sprintf(msg, "[Validator %d] Error creating the PoW verification threads", id);
+    log_message(msg, 'w', 1);
+    exit(-1);
+  }
 
-    TxBlock block = recv->block;
-    int miner_id = recv->miner_id;
-    // block.transactions = NULL;
-    block.transactions = malloc(tx_per_block * sizeof(Tx));
-    memcpy(block.transactions, recv->transactions, tx_per_block * sizeof(Tx));
+  // Commit stage: the blocks are committed in groups, in the order they were read
+  Tx *group_txs = (Tx*)malloc(sizeof(Tx) * tx_per_block * commit_batch);  // -> Transactions of the accepted blocks
+  int count;
+  while ((count = gather_batch()) > 0) {
+    unsigned long long allocations = get_thread_allocations();
+    int valid[MAX_COMMIT_BATCH], saved[MAX_COMMIT_BATCH];
+    int num_valid = 0, num_txs = 0, aging = 0;
+    char tip[HASH_SIZE];  // -> Hash the next block must build on (the last block accepted)
+    char base[HASH_SIZE]; // -> Ledger tip the group builds on (checked again when it is published)
 
-    sprintf(msg, "[Validator %d] Received block %s for validation from miner %d", id, block.id, miner_id);
-    log_message(msg, 'r', 1);
+    sem_wait(hash_mutex);
+    strcpy(tip, last_hash);
+    sem_post(hash_mutex);
 
-    // -- Verify the block's PoW
-    PoWResult result;
-    do {
-      result = proof_of_work(&block);
-    } while (result.error == 1);
-    if (strcmp(recv->result_hash, result.hash) != 0) {
-      is_valid = 0;
-      if (DEBUG) {
-        sprintf(msg, "[Validator %d] Block %s invalid: Invalid PoW", id, block.id);
-        log_message(msg, 'w', 1);
-      }
-    }
+    // The PoW was already verified in parallel, the chain and pool checks
+    // depend on the previous blocks and run block by block, in order
+    for (int b = 0; b < count; b++) {
+      ValidationJob *job = &jobs[(jobs_committed + b) % pipeline_depth];
+      PipeMsg *recv = job->recv;
+      valid[b] = 1;
 
-    // Check if the previous block hash matches the hash of the last block added to the ledger
-    if (is_valid) {
+      // Check if the previous block hash matches the hash of the last block accepted
       // -- If the current block is not the first block on the ledger, check the hash
-      sem_wait(hash_mutex);
-      if (last_hash[0] != '\0')
-        if (strcmp(last_hash, block.previous_block_hash) != 0) {
-          is_valid = 0;
-          sprintf(msg, "[Validator %d] Block %s invalid: Previous block hash does not match the last block's hash", id, block.id);
+      int waited = 0;
+      while (tip[0] != '\0' && strcmp(tip, recv->block.previous_block_hash) != 0) {
+        // -- A speculative block can arrive while its parent is still being validated by another validator,
+        // -- any other block on a different parent lost a race and is rejected right away
+        if (!recv->speculative || num_valid > 0 || waited++ >= SPECULATIVE_WAIT) {
+          valid[b] = 0;
+          sprintf(msg, "[Validator %d] Block %s invalid: Previous block hash does not match the last block's hash", id, recv->block.id);
           log_message(msg, 'w', 1);
+          break;
         }
-      sem_post(hash_mutex);
-    }
+        usleep(1000);
+        sem_wait(hash_mutex);
+        strcpy(tip, last_hash);
+        sem_post(hash_mutex);
+      }
 
-    // -- Check if the transactions are still in the transactions pool
-    if (is_valid) {
-      sem_wait(tx_pool_mutex);
-      for (int i = 0; i < tx_per_block; i++) {
-        int found = 0;
-        Tx cur_tx = block.transactions[i];
-        for (int j = 0; j < tx_pool_size; j++) {
-          TxPoolNode *cur_node = &tx_pool[j];
-          if (cur_node->empty == 0 && strcmp(cur_node->tx.id, cur_tx.id) == 0) {
-            found = 1;
+      // -- Check if the transactions are still in the transactions pool (and not in a block accepted before)
+      if (valid[b]) {
+        for (int i = 0; i < tx_per_block; i++) {
+          const char *tx_id = recv->transactions[i].id;
+          if (!tx_pool_contains(tx_pool_header, tx_pool, tx_id) || in_group(group_txs, num_txs, tx_id)) {
+            valid[b] = 0;
+            sprintf(msg, "[Validator %d] Block %s invalid: Transaction %s not in the pool", id, recv->block.id, tx_id);
+            log_message(msg, 'w', 1);
             break;
           }
         }
+        aging++;
+      }
 
-        if (!found) {
-          is_valid = 0;
-          sprintf(msg, "[Validator %d] Block %s invalid: Transaction %s not in the pool", id, block.id, cur_tx.id);
+      // -- Verify the block's PoW (hashed by the PoW stage)
+      if (valid[b] && !job->pow_valid) {
+        valid[b] = 0;
+        if (DEBUG) {
+          sprintf(msg, "[Validator %d] Block %s invalid: Invalid PoW", id, recv->block.id);
           log_message(msg, 'w', 1);
-          break;
         }
       }
-      increment_age(tx_pool, tx_pool_size);  // -> Aging
-      sem_post(tx_pool_mutex);
+
+      if (valid[b]) {
+        memcpy(group_txs + num_txs, recv->transactions, sizeof(Tx) * tx_per_block);
+        num_txs += tx_per_block;
+        if (num_valid == 0)
+          strcpy(base, tip);
+        strcpy(tip, job->hash);
+        num_valid++;
+      }
     }
 
-    // -- Calculate the reward
-    int total_reward = 0;
-    if (is_valid)
-      for (int i = 0; i < tx_per_block; i++)
-        total_reward += block.transactions[i].reward;
+    // -- Another validator may have moved the tip since the group was checked: the whole group is then stale
+    int published = 0;
+    if (num_valid > 0) {
+      sem_wait(hash_mutex);  // -> Held until the group is published, so the tip cannot move under it
+      if (strcmp(last_hash, base) != 0) {
+        sem_post(hash_mutex);
+        for (int b = 0; b < count; b++) {
+          if (!valid[b])
+            continue;
+          valid[b] = 0;
+          sprintf(msg, "[Validator %d] Block %s invalid: Previous block hash does not match the last block's hash",
+                  id, jobs[(jobs_committed + b) % pipeline_depth].recv->block.id);
+          log_message(msg, 'w', 1);
+        }
+      }
+      else
+        published = 1;
+    }
 
-    if (is_valid) {
-      // -- Place the validated block on the ledger
+    if (published) {
+      // -- Place the accepted blocks on the ledger (one lock for the group)
       sem_wait(ledger_mutex);
-      int saved = save_block(&blocks, &block);
-      sem_post(ledger_mutex);
-      if (saved) {
-        sprintf(msg, "[Validator %d] Block %s added to the ledger", id, block.id);
-        log_message(msg, 'r', DEBUG);
-      }
-      else {
-        sprintf(msg, "[Validator %d] Error saving block %s to the ledger", id, block.id);
-        log_message(msg, 'w', 1);
+      for (int b = 0; b < count; b++) {
+        if (!valid[b])
+          continue;
+        PipeMsg *recv = jobs[(jobs_committed + b) % pipeline_depth].recv;
+        TxBlock block = recv->block;
+        block.transactions = recv->transactions;
+        saved[b] = save_block(&blocks, &block);
       }
+      sem_post(ledger_mutex);
 
-      // -- Remove the block's transactions from the pool
-      sem_wait(tx_pool_mutex);
-      for (int i = 0; i < tx_per_block; i++)
-        for (int j = 0; j < tx_pool_size; j++)
-          if (tx_pool[j].empty == 0 && strcmp(tx_pool[j].tx.id, block.transactions[i].id) == 0) {
-            // printf("[DEBUG] [Validator] *** Removing transaction %s from the pool\n", tx_pool[j].tx.id);
-            tx_pool[j].empty = 1;
-            sem_post(tx_pool_empty);
-            break;
-          }
-
-      // -- Age the transactions in the pool
-      increment_age(tx_pool, tx_pool_size);  // -> Aging
-      sem_post(tx_pool_mutex);
+      // -- Remove the group's transactions from the pool (each shard is locked once)
+      int removed = tx_pool_remove_batch(tx_pool_header, tx_pool, group_txs, num_txs);
+      for (int i = 0; i < removed; i++)
+        sem_post(tx_pool_empty);
+      aging += num_valid;
 
-      // Save the hash of the current block for future validation of the previous block hash
-      sem_wait(hash_mutex);
-      strcpy(last_hash, result.hash);
+      // Save the hash of the last block for future validation of the previous block hash
+      strcpy(last_hash, tip);
+      atomic_fetch_add(tip_epoch, 1);  // -> Miners still working on the old tip drop their blocks
       sem_post(hash_mutex);
-      sprintf(msg, "[Validator %d] Block %s validated successfully", id, block.id);
-      log_message(msg, 'r', 1);
       sem_post(check_occupancy);  // -> Unblock the Validator Manager to check the pool's occupancy
     }
 
-    // Send the results to the statistics process
+    // -- Age the transactions in the pool (one step per block checked against the pool and per block added)
+    for (int i = 0; i < aging; i++)
+      increment_age(tx_pool_header);
+
+    // Send the results of the group to the statistics process (one message)
     Message to_send;
-    to_send.miner_id = miner_id;
-    to_send.msgtype = 1;
-    to_send.valid_block = is_valid;
-    if (is_valid) {
-      to_send.creation_time = recv->block.timestamp;
-      to_send.validation_time = get_timestamp();
-      to_send.credits = total_reward;
+    to_send.msgtype = MSG_BLOCK_RESULT;
+    to_send.num_results = count;
+    Timestamp validation_time = get_timestamp();
+    for (int b = 0; b < count; b++) {
+      ValidationJob *job = &jobs[(jobs_committed + b) % pipeline_depth];
+      PipeMsg *recv = job->recv;
+      BlockResult *result = &to_send.results[b];
+      result->miner_id = recv->miner_id;
+      result->valid_block = valid[b];
+      result->mining_cpu_time = recv->mining_cpu_time;
+      result->mining_hashes = recv->mining_hashes;
+
+      if (valid[b]) {
+        // -- Calculate the reward
+        result->credits = 0;
+        for (int i = 0; i < tx_per_block; i++)
+          result->credits += recv->transactions[i].reward;
+        result->creation_time = recv->block.timestamp;
+        result->validation_time = validation_time;
+
+        if (saved[b]) {
+          sprintf(msg, "[Validator %d] Block %s added to the ledger", id, recv->block.id);
+          log_message(msg, 'r', DEBUG);
+        }
+        else {
+          sprintf(msg, "[Validator %d] Error saving block %s to the ledger", id, recv->block.id);
+          log_message(msg, 'w', 1);
+        }
+        sprintf(msg, "[Validator %d] Block %s validated successfully", id, recv->block.id);
+        log_message(msg, 'r', 1);
+      }
+      else
+        tx_pool_release(tx_pool_header, tx_pool, recv->transactions, tx_per_block, recv->miner_id);  // -> Other miners can take them
+    }
+    msgsnd(msq_id, &to_send, MESSAGE_SIZE(count), 0);
+    if (count > 1) {
+      sprintf(msg, "[Validator %d] Committed a group of %d blocks (%d valid)", id, count, published ? num_valid : 0);
+      log_message(msg, 'r', DEBUG);
     }
-    msgsnd(msq_id, &to_send, sizeof(Message) - sizeof(long), 0);
 
-    free(block.transactions);
-    free(recv);
+    // -- Debug check: validating a group of blocks must not touch the heap
+    if (DEBUG && get_thread_allocations() != allocations) {
+      sprintf(msg, "[Validator %d] %llu heap allocations while validating %d blocks", id,
+              get_thread_allocations() - allocations, count);
+      log_message(msg, 'w', 1);
+    }
+
+    if (block_transport == TRANSPORT_RING)
+      for (int b = 0; b < count; b++)
+        block_ring_release(block_ring, jobs[(jobs_committed + b) % pipeline_depth].slot_pos);
+
+    pthread_mutex_lock(&pipeline_mutex);
+    jobs_committed += count;
+    pthread_cond_signal(&job_committed);
+    pthread_mutex_unlock(&pipeline_mutex);
   } // -> while (1)
+  free(group_txs);
+
+  pthread_join(intake_id, NULL);
+  for (int i = 0; i < num_verify; i++)
+    pthread_join(verify_id[i], NULL);
+  if (block_transport == TRANSPORT_FIFO)
+    for (unsigned int i = 0; i < pipeline_depth; i++)
+      free(jobs[i].buffer);
+  free(jobs);
 
   // Process termination
   sprintf(msg, "[Validator %d] Process terminated", id);